@@ -15,11 +15,15 @@
 #include "utils.h"
 #include "virtexp.h"
 #include "distributor.h"
+#include "telemetry.h"
+#include "archive.h"
 #include <math.h>
 
 
 extern int verbosity;
 
+#define FITNESS_CACHE 100000	// genomes the engine knows the fitness of, the cache is emptied once full
+
 //Genome handler
 class Genome
 {
@@ -27,13 +31,17 @@ class Genome
         ALLELE m_Alleles;
         double m_Fitness;
         bool m_Valid;
+        bool m_Bounded;
+        double m_Screened;
+        bool m_Confirmed;
 
     public:
 		// constructors & destructors
-        Genome():m_Fitness(0.0),m_Valid(true)
+        Genome():m_Fitness(0.0),m_Valid(true),m_Bounded(false),m_Screened(0.0),m_Confirmed(true)
         {
         }
-        Genome(const Genome& other):m_Fitness(other.m_Fitness),m_Valid(other.m_Valid)
+        Genome(const Genome& other):m_Fitness(other.m_Fitness),m_Valid(other.m_Valid),m_Bounded(other.m_Bounded),
+                                    m_Screened(other.m_Screened),m_Confirmed(other.m_Confirmed)
         {
             m_Alleles.assign(other.m_Alleles.begin(),other.m_Alleles.end());
         }
@@ -49,6 +57,9 @@ class Genome
                 m_Alleles.assign(other.m_Alleles.begin(),other.m_Alleles.end());
                 m_Fitness=other.m_Fitness;
                 m_Valid=other.m_Valid;
+                m_Bounded=other.m_Bounded;
+                m_Screened=other.m_Screened;
+                m_Confirmed=other.m_Confirmed;
              }
             return *this;
         }
@@ -56,22 +67,24 @@ class Genome
 		// allele
         double allele(const std::wstring& name)
         {
+            int id=Symbols::find(name);
             ALLELE::iterator it=find_if(m_Alleles.begin(),m_Alleles.end(),
-                   bind1st(pair_equal_to<std::wstring,double>(),name));		// pair_equal_to argument std::wstring& ?
+                   bind1st(pair_equal_to<int,double>(),id));
             return (it==m_Alleles.end()?double(0.0):it->second);			// returns 0.0 if name not found and m_Alleles' second value if found 
         }
         double allele(int index)
         {
             return ((index>=0 && index<m_Alleles.size())?m_Alleles[index].second:0.0);	// second val of ith pair of m_Alleles; if index out of range, 0.0
         }
-        void allele(const std::wstring& name,double val)		// if m_Alleles has an element with first==name, assign the second to val; push_back <name,val> into m_Allele
+        void allele(const std::wstring& name,double val)		// if m_Alleles has an element with first==id of name, assign the second to val; push_back <id,val> into m_Allele
         {
+            int id=Symbols::id(name);
             ALLELE::iterator it=find_if(m_Alleles.begin(),m_Alleles.end(),
-                   bind1st(pair_equal_to<std::wstring,double>(),name));
+                   bind1st(pair_equal_to<int,double>(),id));
             if(it!=m_Alleles.end())
                it->second=val;
             else
-               m_Alleles.push_back(std::make_pair<std::wstring,double>(std::wstring(name),double(val)));
+               m_Alleles.push_back(std::make_pair(id,val));
         }
         void allele(int index,double val)		// assigns the second memb of the i(ndex)th elem of m_Alleles to val, if in range
         {
@@ -83,11 +96,30 @@ class Genome
         bool valid() const { return m_Valid; }
         void valid(bool b) { m_Valid=b; }		// assign m_Valid member to b
 
+		// bounded: evaluation was aborted, fitness is only known to be worse than m_Fitness
+        bool bounded() const { return m_Bounded; }
+        void bounded(bool b) { m_Bounded=b; }
+
+		// screened: fitness evaluated with screening accuracy
+        double screened() const { return m_Screened; }
+        void screened(double v) { m_Screened=v; }
+
+		// confirmed: fitness has been evaluated with full accuracy, otherwise it is the screened one
+        bool confirmed() const { return m_Confirmed; }
+        void confirmed(bool b) { m_Confirmed=b; }
+
+		// id
+        int id(int index)
+        {
+			// rts first memb of ith elem of m_Alleles; if index out of range, -1
+            return ((index>=0 && index<m_Alleles.size())?m_Alleles[index].first:-1);
+        }
+
 		// name
         std::wstring name(int index)
         {
-			// rts first memb of ith elem of m_Alleles; if index out of range, an empty string
-            return ((index>=0 && index<m_Alleles.size())?m_Alleles[index].first:std::wstring());
+			// rts the name of ith allele; if index out of range, an empty string
+            return Symbols::name(id(index));
         }
 
 		// size
@@ -98,11 +130,11 @@ class Genome
         }
 
 		// [] operator (indexing)
-        std::pair<std::wstring,double>& operator[](int index)
+        std::pair<int,double>& operator[](int index)
         {	
-			// pushback <emptystr, 0.0> to m_Alleles until vector index is in range, then return that elem of m_Alleles
+			// pushback <-1, 0.0> to m_Alleles until vector index is in range, then return that elem of m_Alleles
             while(m_Alleles.size()<=index)
-				m_Alleles.push_back(std::make_pair(std::wstring(),double(0.0)));
+				m_Alleles.push_back(std::make_pair(int(-1),double(0.0)));
 			return m_Alleles[index];
         }
 
@@ -158,10 +190,13 @@ class Genome
         void var(VariablesHolder& v)
         {
 			// iterate through the alleles in this genome
-            for(ALLELE::iterator it=m_Alleles.begin();it!=m_Alleles.end();++it)
+            for(int i=0;i<m_Alleles.size();i++)
             {
-				// update each allele in v
-                v(it->first,it->second);
+				// alleles in the order of v are stored in place, the rest are looked up
+                if(v.id(i)==m_Alleles[i].first)
+                    v.values()[i]=m_Alleles[i].second;
+                else
+                    v(m_Alleles[i].first,m_Alleles[i].second);
             }
         }
 
@@ -169,18 +204,11 @@ class Genome
         void set(VariablesHolder& v)
         {
 			// rebuild alleles from that stored in a varholder
+            const double *values=v.values();
 
-            m_Alleles.clear();	// clear m_Alleles vector
-			// m_Alleles is an empty vector of pair
-
-            for(int k=0;;k++)
-            {
-				std::wstring name=v.name(k);
-				if(name.empty())	// k reached the end of m_Var in v
-					break;
-
-                m_Alleles.push_back(std::make_pair<std::wstring,double>(name,v(name)));		// append a pair made from m_Vars of v to m_Alleles
-            }
+            m_Alleles.resize(v.size());
+            for(int k=0;k<m_Alleles.size();k++)
+                m_Alleles[k]=std::make_pair(v.id(k),values[k]);
         }
 };
 
@@ -204,15 +232,23 @@ class GAEngine
         bool m_bBestFitnessAssigned;
         VariablesHolder m_bestVariables;
         bool m_UseBlockSample;
+        bool m_EarlyAbort;
+        double m_ScreenMargin;
+        Telemetry *m_pTelemetry;
+        Archive *m_pArchive;
+        std::map<std::vector<double>,double> m_Known;	// fitness of the genomes evaluated completely, by allele values
+        std::vector<double> m_Key;
 
     public:
         typedef Genome GENOME;
 
 		// default GA Engine constructor
-        GAEngine():m_MaxPopulation(0),m_Generations(1),
+        GAEngine():m_MaxPopulation(0),
                    m_CrossProbability(0.2),m_MutationProbability(0.01),
-                   m_bBestFitnessAssigned(false),m_UseBlockSample(false),
-                   m_crossPartition(0),m_mutatePartition(0)
+                   m_crossPartition(0),m_mutatePartition(0),m_Generations(1),
+                   m_bBestFitnessAssigned(false),m_UseBlockSample(false),m_EarlyAbort(false),m_ScreenMargin(0.0),
+                   m_pTelemetry(NULL),m_pArchive(NULL),
+                   m_Phase(PHASE_DONE),m_Generation(0),m_Job(0),m_Bound(INFINITY),m_Fidelity(FIDELITY_FULL),m_Started(0.0),m_Breed(0.0)
         {
         }
         ~GAEngine()
@@ -225,6 +261,11 @@ class GAEngine
         int& part_mutate() { return m_mutatePartition; }
 
         bool& block_sample() { return m_UseBlockSample; }
+        bool& early_abort() { return m_EarlyAbort; }
+        double& screen_margin() { return m_ScreenMargin; }
+        void telemetry(Telemetry *t) { m_pTelemetry=t; }	// record every generation to t, NULL for none
+        void archive(Archive *a) { m_pArchive=a; }	// append every genome evaluated completely to a, NULL for none
+        const std::vector<std::wstring>& alleles() const { return m_AlleleList; }
 
 		// Set the maximum population size of GA and resize the population Genome vector accordingly
         void set_borders(int max_population)
@@ -263,13 +304,61 @@ class GAEngine
 
 
         int size() { return m_Population.size(); }
+
+		// warm_start
+		// the archived genomes within the limits of the alleles become known,
+		// the best of them replace up to half of the population; returns the number of genomes replaced
+        int warm_start(std::vector<Archive::Record>& records)
+        {
+            std::vector<std::pair<double,int> > order;
+
+            for(int i=0;i<records.size();i++)
+            {
+                Archive::Record& r=records[i];
+                bool within=(r.fitness!=INFINITY && r.alleles.size()==m_AlleleList.size());
+
+                for(int k=0;within && k<r.alleles.size();k++)
+                {
+                    LIMITS::iterator it=m_Limits.find(Symbols::id(m_AlleleList[k]));
+                    within=(it==m_Limits.end() || (r.alleles[k]>=it->second.first && r.alleles[k]<=it->second.second));
+                }
+                if(!within || m_Known.find(r.alleles)!=m_Known.end())
+                    continue;
+                if(m_Known.size()>=FITNESS_CACHE)
+                    break;
+                m_Known[r.alleles]=r.fitness;
+                order.push_back(std::make_pair(r.fitness,i));
+            }
+            std::sort(order.begin(),order.end());
+
+            int n=std::min((int)order.size(),(int)m_Population.size()/2);
+            for(int i=0;i<n;i++)
+            {
+                Archive::Record& r=records[order[i].second];
+                Genome& g=m_Population[i];
+
+                for(int k=0;k<r.alleles.size();k++)
+                    g.allele(k,r.alleles[k]);
+            }
+            return n;
+        }
+
+		// sample
+		// store the variables of the first n genomes of the population in v
+        void sample(int n,std::vector<VariablesHolder>& v)
+        {
+            v.resize(std::min(n,(int)m_Population.size()));
+            for(int i=0;i<v.size();i++)
+                m_Population[i].var(v[i]);
+        }
+
         void AddAllele(const std::wstring& name)
         {
             m_AlleleList.push_back(name);
         }
         void AddLimit(const std::wstring& name,double lower,double upper)
         {
-            m_Limits[name]=std::make_pair(double(lower),double(upper));
+            m_Limits[Symbols::id(name)]=std::make_pair(double(lower),double(upper));
         }
 		
 		// var_template
@@ -293,171 +382,327 @@ class GAEngine
 		// returns a pointer to a newly initiated WorkItem that has collated h's allele values
         WorkItem *var_to_workitem(VariablesHolder& h)
         {
-            WorkItem *w=new WorkItem;
-            w->key=0;
-            h.collate(w->data);
+            WorkItem *w=Distributor::instance().get(h.size());
+            std::copy(h.values(),h.values()+h.size(),w->data.begin());
             return w;
         }
 
 		// process_workitem
-		// assigns the key-th Genome of m_Pop's m_fitness to answer, and deletes the WorkItem
+		// assigns the key-th Genome of m_Pop's m_fitness to answer, the WorkItem returns to the distributor's pool
         void process_workitem(WorkItem *w,double answer)
         {
-            if(w->key<m_Population.size())
+            if(w->key>=m_Population.size())
+                return;
+
+            Genome& g=m_Population[w->key];
+            g.fitness(answer);
+            g.bounded(w->bounded);
+            g.confirmed(w->fidelity==FIDELITY_FULL);
+            if(w->fidelity==FIDELITY_SCREEN)
+                g.screened(answer);
+            if(w->fidelity==FIDELITY_FULL && !w->bounded)
             {
-                Genome& g=m_Population[w->key];
-                g.fitness(answer);
+                m_Key.resize(g.size());
+                for(int k=0;k<g.size();k++)
+                    m_Key[k]=g.allele(k);
+                if(m_pArchive)
+                    m_pArchive->write(answer,w->seconds,m_Key,w->residuals);
+                //failures are not known for sure as they may be down to the time limit
+                if(answer!=INFINITY)
+                {
+                    if(m_Known.size()>=FITNESS_CACHE)
+                        m_Known.clear();
+                    m_Known[m_Key]=answer;
+                }
             }
-            delete w;
+        }
+
+		// known
+		// set the fitness of the genome if it has been evaluated completely before, true if so
+        bool known(Genome& g)
+        {
+            if(m_Known.empty())
+                return false;
+            m_Key.resize(g.size());
+            for(int k=0;k<g.size();k++)
+                m_Key[k]=g.allele(k);
+
+            std::map<std::vector<double>,double>::iterator it=m_Known.find(m_Key);
+            if(it==m_Known.end())
+                return false;
+            g.fitness(it->second);
+            g.bounded(false);
+            g.confirmed(true);
+            return true;
         }
 
 		// RunGenerations
 		/**
 		 *	run the GA engine for given number of generations
 		 *
-		 *
+		 *	the engine is advanced a phase at a time, the work of every phase is processed
+		 *	by the distributor before the next phase starts
 		 **/
         void RunGenerations(int gener)
         {
-            VariablesHolder v;
-       
+            Start(gener);
+            while(Advance())
+                Distributor::instance().process(observer,this);
+        }
+
+		// Start
+		// begin a run of gener generations, the phases are then run by Advance()
+        void Start(int gener)
+        {
             m_Generations=gener;
+            m_Generation=-1;		// -1 for initial generation
+            m_Phase=PHASE_START;
+            if(!m_Layout.size())
+                var_template(m_Layout);
+        }
+
+		// Advance
+		/**
+		 *	complete the phase whose work has been processed and queue the work of the following one
+		 *	returns false once the last generation is complete
+		 **/
+        bool Advance()
+        {
+            switch(m_Phase)
+            {
+                case PHASE_START:
+                    begin_phase();
+                    evaluate_initial();
+                    m_Phase=PHASE_EVALUATED;
+                    return true;
+                case PHASE_BRED:
+                    //Confirm the screened offspring which are within the margin of the survivors
+                    if(m_Fidelity==FIDELITY_SCREEN)
+                    {
+                        confirm();
+                        m_Phase=PHASE_EVALUATED;
+                        return true;
+                    }
+                    //fall through, nothing to confirm
+                case PHASE_EVALUATED:
+                    complete_generation();
+                    if(++m_Generation>=m_Generations)
+                    {
+                        m_Phase=PHASE_DONE;
+                        return false;
+                    }
+                    begin_phase();
+                    breed();
+                    m_Phase=PHASE_BRED;
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+		// job
+		// the work of the engine is tagged with the job when several engines share the distributor
+        void job(int j) { m_Job=j; }
+
+		// layout
+		// the alleles of the workitems in order, those of other jobs left NaN; by default the alleles of the engine
+        void layout(const VariablesHolder& v) { m_Layout=v; }
+
+    private:
+		// phases of a generation, PHASE_EVALUATED follows PHASE_BRED if the offspring are screened
+        enum { PHASE_START, PHASE_BRED, PHASE_EVALUATED, PHASE_DONE };
+
+        int m_Phase;
+        int m_Generation;		// generation being run, -1 for the initial population
+        int m_Job;
+        VariablesHolder m_Layout;
+        POPULATION m_Previous;	// population the offspring are bred from
+        double m_Bound;			// offspring worse than that are not evaluated completely
+        int m_Fidelity;			// fidelity the offspring are evaluated with
+        std::vector<int> m_Offspring;
+        double m_Started;		// wall time the phase started at
+        double m_Breed;			// seconds spent queuing the work of the generation
+
+		// begin_phase
+		// start timing the queuing of work
+        void begin_phase()
+        {
+            m_Started=monotonic_time();
+            if(m_pTelemetry)
+                Distributor::instance().reset_stats();
+        }
+
+		// dispatch
+		// queue the evaluation of the index-th genome unless its fitness is known
+		// v holds the alleles of the genome
+        bool dispatch(int index,VariablesHolder& v,double bound,int fidelity)
+        {
+            if(known(m_Population[index]))
+                return false;
+            WorkItem *w=var_to_workitem(v);
+            w->key=index;
+            w->job=m_Job;
+            w->threshold=bound;
+            w->fidelity=fidelity;
+            Distributor::instance().push(w);
+            return true;
+        }
+
+		// evaluate_initial
+		// queue the evaluation of the initial population
+        void evaluate_initial()
+        {
+            VariablesHolder v(m_Layout);
 
             //Create initial fitness set
 			for(int i=0;i<m_Population.size();i++)
 			{
-				Genome& g=m_Population[i];	// get the ith Genome in population
-
 				// 'update' all alleles of this genome into temporary variable storage
-				g.var(v);	// strange behaviour when this genome is incomplete
-				WorkItem *w=var_to_workitem(v);		// initiate a ptr workitem that has collated this genome's allele values
-				w->key=i;	// assign this workitem's key accordingly
-				Distributor::instance().push(w);	// push this work into the singleton distributor
+				m_Population[i].var(v);	// strange behaviour when this genome is incomplete
+				dispatch(i,v,INFINITY,FIDELITY_FULL);
 			}
+            m_Breed=monotonic_time()-m_Started;
+        }
 
-			// Process the works
-			Distributor::instance().process(observer,this);		//?? this must be assigning the fitness of each genome in population: HINT this meaning the GAEngine obj
+		// breed
+		// select the population of the generation and queue the evaluation of the offspring
+        void breed()
+        {
+            VariablesHolder v(m_Layout);
 
-			std::sort(m_Population.begin(),m_Population.end(),reverse_compare);		// sort m_Population (vector<Genome>) by reverse_compare: in ascending order of fitness
-            
-			// check if best ftns is assigned. if not, assign it	(fitness minimisation!)
-			if(!m_bBestFitnessAssigned || m_bestFitness>m_Population[0].fitness())
+			//Do the genetics
+            int limit=m_Population.size();
+            //Create new population
+            m_Previous=m_Population;		// previous generation
+ 
+            m_Population.clear();		// clear current population vector
+            m_Bound=abort_threshold(m_Previous);	// offspring worse than that are not evaluated completely
+            m_Fidelity=(m_ScreenMargin>0.0?FIDELITY_SCREEN:FIDELITY_FULL);	// offspring are screened first
+            if(m_Fidelity==FIDELITY_SCREEN)
+                m_Bound*=1.0+m_ScreenMargin;	// screening must not abort the offspring confirm() takes
+            m_Offspring.clear();
+
+			// SELECTION
+			// select Genomes from prev gen to carry on; store in m_Population vector
+            for(int i=0;i<limit;i++)
             {
-                m_bestFitness=m_Population[0].fitness();	// assign min ftns as the best fitness
-                m_Population[0].var(m_bestVariables);		// update the bestVars
-                m_bBestFitnessAssigned=true;
+                int mem=select_weighted(m_Previous);		// mem is the randomly selected Genome's index (p.size()-1 when err)
+                //printf("Adding %d to population\n",mem);
+                m_Population.push_back(m_Previous[mem]);	// append the selected Genome into curr Pop vector
             }
 
-            print_stage(-1);		// -1 for initial generation
 
-            for(int g=0;g<gener;g++)
+            //Do the crossovers
+            if(m_crossPartition)
             {
-				//Do the genetics
-				int limit=m_Population.size();
-                //Create new population
-                POPULATION prev(m_Population);		// prev is a copy of current pop vector
- 
-                m_Population.clear();		// clear current population vector
-                double l=(double)prev.size()-0.5;
-
-				// SELECTION
-				// select Genomes from prev gen to carry on; store in m_Population vector
-                for(int i=0;i<limit;i++)
-                {
-                    int mem=select_weighted(prev);		// mem is the randomly selected Genome's index (p.size()-1 when err)
-                    //printf("Adding %d to population\n",mem);
-                    m_Population.push_back(prev[mem]);	// append the selected Genome into curr Pop vector
-                }
+                std::vector<int> sample;	// initialise an integer vector
 
+                if(!m_UseBlockSample)
+                    build_rnd_sample_rnd(sample,m_CrossProbability*100.0,true);		// fill sample with indices to perform crossover
+                else
+                    build_rnd_sample(sample,m_crossPartition,true,true);			// disallow duplicates in building sample (size m_crossPartition)
 
-                //Do the crossovers
-                if(m_crossPartition)
+                for(int i=0;i<sample.size();i++)
                 {
-                    std::vector<int> sample;	// initialise an integer vector
+                    std::vector<int> arena; //initialise arena for breeding
+                    
+                    arena.push_back(sample[i]);	//ith sample enters arena 
+					//bulid tournament sample
+                    build_rnd_sample(arena,1,true,true); //another sample enters arena, avoid self for crossbreeding
 
-                    if(!m_UseBlockSample)
-                        build_rnd_sample_rnd(sample,m_CrossProbability*100.0,true);		// fill sample with indices to perform crossover
-                    else
-                        build_rnd_sample(sample,m_crossPartition,true,true);			// disallow duplicates in building sample (size m_crossPartition)
+					//cross the Genomes in arena at a randomly selected crosspoint
+	    			cross(m_Population[arena[0]],m_Population[arena[1]],
+						(int)rnd_generate(1.0,m_Population[sample[i]].size()));		//crosspoint in [1,allele length of ith sample genome]
 
-                    for(int i=0;i<sample.size();i++)
+                    for(int j=0;j<2;j++)
                     {
-                        std::vector<int> arena; //initialise arena for breeding
-                        
-                        arena.push_back(sample[i]);	//ith sample enters arena 
-						//bulid tournament sample
-                        build_rnd_sample(arena,1,true,true); //another sample enters arena, avoid self for crossbreeding
-
-						//cross the Genomes in arena at a randomly selected crosspoint
-	    				cross(m_Population[arena[0]],m_Population[arena[1]],
-							(int)rnd_generate(1.0,m_Population[sample[i]].size()));		//crosspoint in [1,allele length of ith sample genome]
-
-                        for(int j=0;j<2;j++)
-                        {
-							m_Population[arena[j]].var(v);
-                            Distributor::instance().remove_key(arena[j]); //remove previously requested processing
-							WorkItem *w=var_to_workitem(v);
-							w->key=arena[j];
-							Distributor::instance().push(w);
-                        }
+						m_Population[arena[j]].var(v);
+                        Distributor::instance().remove_key(arena[j],m_Job); //remove previously requested processing
+                        if(dispatch(arena[j],v,m_Bound,m_Fidelity))
+							m_Offspring.push_back(arena[j]);
                     }
                 }
+            }
 
 
-                //Do the mutations
-                if(m_mutatePartition)
-                {
-                    std::vector<int> sample;
-
-                    if(!m_UseBlockSample)
-                        build_rnd_sample_rnd(sample,m_MutationProbability*100.0,false);	//sample vector includes even invalid Genomes
-                    else
-                        build_rnd_sample(sample,m_mutatePartition,false,false); //allow duplicates and invalid genomes to build sample (size m_mutatePartition)
-
-					//Treatment of invalid genomes in the population
-                    for(int i=0;i<m_Population.size();i++)
-                    {
-						//add all unselected invalid genomes into sample
-						if(!m_Population[i].valid() && std::find(sample.begin(),sample.end(),i)==sample.end())
-							sample.push_back(i);
-                    }
-
-					//Mutate invalid population members
-                    for(int i=0;i<sample.size();i++)
-                    {
-	    				mutate(std::wstring(),m_Population[sample[i]],!(m_Population[sample[i]].valid()));	// mutate-all iff genome is invalid. else mutate approx 1 allele
-						m_Population[sample[i]].var(v);
-                        Distributor::instance().remove_key(sample[i]); //remove previously requested processing
-						WorkItem *w=var_to_workitem(v);
-                        m_Population[sample[i]].set(v);		//??
-						w->key=sample[i];
-						Distributor::instance().push(w);
-                    }
-                }
+            //Do the mutations
+            if(m_mutatePartition)
+            {
+                std::vector<int> sample;
 
-				//Run the distribution
-				Distributor::instance().process(observer,this);
-				std::sort(m_Population.begin(),m_Population.end(),reverse_compare);
+                if(!m_UseBlockSample)
+                    build_rnd_sample_rnd(sample,m_MutationProbability*100.0,false);	//sample vector includes even invalid Genomes
+                else
+                    build_rnd_sample(sample,m_mutatePartition,false,false); //allow duplicates and invalid genomes to build sample (size m_mutatePartition)
 
-                if(m_Population.size()>m_MaxPopulation)
+				//Treatment of invalid genomes in the population
+                for(int i=0;i<m_Population.size();i++)
                 {
-                    //Cull it
-					m_Population.erase(m_Population.begin()+m_MaxPopulation,m_Population.end());
+					//add all unselected invalid genomes into sample
+					if(!m_Population[i].valid() && std::find(sample.begin(),sample.end(),i)==sample.end())
+						sample.push_back(i);
                 }
-				
-				// update best fitness
-                if(!m_bBestFitnessAssigned || m_bestFitness>m_Population[0].fitness())
+
+				//Mutate invalid population members
+                for(int i=0;i<sample.size();i++)
                 {
-                    m_bestFitness=m_Population[0].fitness();
-                    m_Population[0].var(m_bestVariables);
-                    m_bBestFitnessAssigned=true;
+	    			mutate(std::wstring(),m_Population[sample[i]],!(m_Population[sample[i]].valid()));	// mutate-all iff genome is invalid. else mutate approx 1 allele
+					m_Population[sample[i]].var(v);
+                    Distributor::instance().remove_key(sample[i],m_Job); //remove previously requested processing
+                    if(dispatch(sample[i],v,m_Bound,m_Fidelity))
+						m_Offspring.push_back(sample[i]);
                 }
-                print_stage(g);
             }
+            m_Breed=monotonic_time()-m_Started;
         }
 
-    private:
-        typedef std::map<std::wstring,std::pair<double,double> > LIMITS;
+		// confirm
+		// queue the full evaluation of the screened offspring within the margin of the survivors
+        void confirm()
+        {
+            VariablesHolder v(m_Layout);
+            double margin=worst_valid(m_Previous)*(1.0+m_ScreenMargin);
+
+            std::sort(m_Offspring.begin(),m_Offspring.end());
+            m_Offspring.erase(std::unique(m_Offspring.begin(),m_Offspring.end()),m_Offspring.end());
+            for(int i=0;i<m_Offspring.size();i++)
+            {
+                Genome& o=m_Population[m_Offspring[i]];
+
+                //a bounded fitness is a lower estimate, within the margin it may still make it
+                if(!o.valid() || o.confirmed() || o.fitness()>margin)
+                    continue;
+                o.var(v);
+                dispatch(m_Offspring[i],v,abort_threshold(m_Previous),FIDELITY_FULL);
+            }
+        }
+
+		// complete_generation
+		// sort the evaluated population, cull it and update the best fitness
+        void complete_generation()
+        {
+            double sorting=monotonic_time();
+
+			std::sort(m_Population.begin(),m_Population.end(),reverse_compare);		// sort m_Population (vector<Genome>) by reverse_compare: in ascending order of fitness
+
+            if(m_Population.size()>m_MaxPopulation)
+            {
+                //Cull it
+				m_Population.erase(m_Population.begin()+m_MaxPopulation,m_Population.end());
+            }
+			
+			// check if best ftns is assigned. if not, assign it	(fitness minimisation!)
+            if(!m_bBestFitnessAssigned || m_bestFitness>m_Population[0].fitness())
+            {
+                m_bestFitness=m_Population[0].fitness();	// assign min ftns as the best fitness
+                m_Population[0].var(m_bestVariables);		// update the bestVars
+                m_bBestFitnessAssigned=true;
+            }
+            record(m_Generation+1,m_Breed,monotonic_time()-sorting);
+            print_stage(m_Generation);
+        }
+
+        typedef std::map<int,std::pair<double,double> > LIMITS;	// by allele id
         LIMITS m_Limits;
 
         void print_stage(int g)
@@ -468,20 +713,13 @@ class GAEngine
                 printf("--------------------------------------------------------\n");
                 for(int j=0;j<m_Population.size();j++)
 				{
-                    VariablesHolder v;
-					
 					//print validity, generation #, and fitness of each chromosome
-                    printf("%s[%d](%lf) ",(m_Population[j].valid()?" ":"*"),g+1,m_Population[j].fitness());
+                    printf("%s[%d](%lf) ",(m_Population[j].valid()?(m_Population[j].bounded()?">":(m_Population[j].confirmed()?" ":"~")):"*"),g+1,m_Population[j].fitness());
 
 					//print each chromosome's alleles (name and value)
-                    for(int k=0;;k++)
+                    for(int k=0;k<m_Population[j].size();k++)
                     {
-                        m_Population[j].var(v);
-						std::wstring name=v.name(k);
-                               
-	    				if(name.empty())
-							break;
-						printf("%s=%lf   ",convert(name).c_str(),v(name));
+						printf("%s=%lf   ",convert(m_Population[j].name(k)).c_str(),m_Population[j].allele(k));
                     }
                     printf("\n");
                 }
@@ -507,10 +745,97 @@ class GAEngine
 			}
 		}
 
+		// record
+		// pass the statistics of the (sorted) population and of the work distributed to the telemetry
+        void record(int generation,double breed,double sort)
+        {
+            if(!m_pTelemetry)
+                return;
+
+            const Distributor::Stats& s=Distributor::instance().stats();
+            Telemetry::Generation r;
+            std::vector<double> fitness;
+
+            for(int i=0;i<m_Population.size();i++)
+            {
+                if(m_Population[i].valid())
+                    fitness.push_back(m_Population[i].fitness());
+                else
+                    r.invalid++;
+            }
+            std::sort(fitness.begin(),fitness.end());
+            r.generation=generation;
+            r.best=(fitness.empty()?INFINITY:fitness.front());
+            r.median=(fitness.empty()?INFINITY:fitness[fitness.size()/2]);
+            r.worst=(fitness.empty()?INFINITY:fitness.back());
+            r.diversity=diversity();
+            r.evaluations=s.evaluations;
+            r.hits=s.hits;
+            r.breed=breed;
+            r.dispatch=s.dispatch;
+            r.wait=s.wait;
+            r.sort=sort;
+            for(int i=0;i<s.busy.size();i++)
+                r.utilization.push_back((s.dispatch+s.wait)>0.0?s.busy[i]/(s.dispatch+s.wait):0.0);
+            m_pTelemetry->write(r);
+        }
+
+		// diversity
+		// standard deviation of every allele over the valid genomes, relative to the limits of the allele if it has them,
+		// averaged over the alleles
+        double diversity()
+        {
+            int alleles=(m_Population.empty()?0:m_Population[0].size());
+            double sum=0.0;
+
+            for(int k=0;k<alleles;k++)
+            {
+                double s=0.0,s2=0.0;
+                int n=0;
+
+                for(int i=0;i<m_Population.size();i++)
+                {
+                    if(!m_Population[i].valid())
+                        continue;
+                    double a=m_Population[i].allele(k);
+                    s+=a;
+                    s2+=a*a;
+                    n++;
+                }
+                if(n<2)
+                    continue;
+
+                double sd=sqrt(std::max(0.0,(s2-s*s/n)/(n-1)));
+                LIMITS::iterator it=m_Limits.find(m_Population[0].id(k));
+                if(it!=m_Limits.end() && it->second.second>it->second.first)
+                    sd/=(it->second.second-it->second.first);
+                sum+=sd;
+            }
+            return (alleles?sum/alleles:0.0);
+        }
+
+		// worst_valid
+		// the worst valid fitness of the (sorted) population p, INFINITY if there is none
+        double worst_valid(POPULATION& p)
+        {
+            for(int i=p.size()-1;i>=0;i--)
+                if(p[i].valid())
+                    return p[i].fitness();
+            return INFINITY;
+        }
+
+		// abort_threshold
+		// the worst valid fitness of the (sorted) population p if early abort is enabled
+        double abort_threshold(POPULATION& p)
+        {
+            return (m_EarlyAbort?worst_valid(p):INFINITY);
+        }
+
 		// mutate
         void mutate(const std::wstring& name,Genome& g,bool mutate_all=false)
         {
             double prob=(mutate_all?101.0:100.0/g.size());
+            int id=(name.size()?Symbols::find(name):-1);
 
             for(int i=0;i<g.size();i++)
             {
@@ -529,9 +854,9 @@ class GAEngine
 
 				// if		name is non-emtpy wstring, only the allele with matching name may be mutated
 				// else if	name is an empty wstring, mutate all alleles
-                if(!name.size() || g.name(i)==name)		
+                if(!name.size() || g.id(i)==id)		
                 {
-                    LIMITS::iterator it=m_Limits.find(g.name(i));	// check for param limits of this allele
+                    LIMITS::iterator it=m_Limits.find(g.id(i));	// check for param limits of this allele
                     double val;
                     if(it==m_Limits.end())
                     {
@@ -560,7 +885,7 @@ class GAEngine
             {
                 if(prob<=probability)
                 {
-                    LIMITS::iterator it=m_Limits.find(g.name(i));
+                    LIMITS::iterator it=m_Limits.find(g.id(i));
                     double val;
                     if(it==m_Limits.end())
                     {
@@ -0,0 +1,176 @@
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "archive.h"
+#include "utils.h"
+
+#define ARCHIVE_MAGIC "VXARCH01"
+
+
+Archive::Archive():m_File(NULL),m_Size(0),m_Quit(false)
+{
+    pthread_mutex_init(&m_Lock,NULL);
+    pthread_cond_init(&m_Queued,NULL);
+}
+
+Archive::~Archive()
+{
+    close();
+    pthread_cond_destroy(&m_Queued);
+    pthread_mutex_destroy(&m_Lock);
+}
+
+//The header of a file of the alleles and experiments
+std::string Archive::header(const std::vector<std::wstring>& alleles,const std::vector<std::string>& experiments)
+{
+    std::string h(ARCHIVE_MAGIC);
+    std::vector<std::string> names;
+    int counts[2]={(int)alleles.size(),(int)experiments.size()};
+
+    for(int i=0;i<alleles.size();i++)
+        names.push_back(convert(alleles[i]));
+    names.insert(names.end(),experiments.begin(),experiments.end());
+    h.append((const char *)counts,sizeof(counts));
+    for(int i=0;i<names.size();i++)
+    {
+        int len=names[i].size();
+
+        h.append((const char *)&len,sizeof(len));
+        h.append(names[i]);
+    }
+    return h;
+}
+
+//Open the file for appending, a new file is given the header
+//a record cut short by an interrupted run is dropped so that the following ones stay aligned
+bool Archive::open(const char *filename,const std::vector<std::wstring>& alleles,const std::vector<std::string>& experiments)
+{
+    std::string h=header(alleles,experiments);
+    std::string existing(h.size(),'\0');
+    long size;
+
+    close();
+    m_Size=2+alleles.size()+experiments.size();
+    m_File=fopen(filename,"a+b");
+    if(!m_File)
+        return false;
+    fseek(m_File,0,SEEK_END);
+    size=ftell(m_File);
+    if(!size)
+        fwrite(h.data(),1,h.size(),m_File);
+    else
+    {
+        fseek(m_File,0,SEEK_SET);
+        if(size<h.size() || fread(&existing[0],1,h.size(),m_File)!=h.size() || existing!=h)
+        {
+            fclose(m_File);
+            m_File=NULL;
+            return false;
+        }
+
+        long partial=(size-h.size())%(m_Size*sizeof(double));
+        if(partial && ftruncate(fileno(m_File),size-partial))
+        {
+            fclose(m_File);
+            m_File=NULL;
+            return false;
+        }
+        //the stream has been read, C requires a positioning call before it is written
+        fseek(m_File,0,SEEK_END);
+    }
+    m_Quit=false;
+    if(pthread_create(&m_Thread,NULL,writer,this))
+    {
+        fclose(m_File);
+        m_File=NULL;
+        return false;
+    }
+    return true;
+}
+
+//Queue the record for the writer, residuals are padded with INFINITY
+void Archive::write(double fitness,double seconds,const std::vector<double>& alleles,const std::vector<double>& residuals)
+{
+    if(!m_File)
+        return;
+
+    int experiments=m_Size-2-alleles.size();
+
+    pthread_mutex_lock(&m_Lock);
+    m_Queue.push_back(fitness);
+    m_Queue.push_back(seconds);
+    m_Queue.insert(m_Queue.end(),alleles.begin(),alleles.end());
+    for(int i=0;i<experiments;i++)
+        m_Queue.push_back(i<residuals.size()?residuals[i]:INFINITY);
+    pthread_cond_signal(&m_Queued);
+    pthread_mutex_unlock(&m_Lock);
+}
+
+//Let the writer drain the queue and wait for it to finish
+void Archive::close()
+{
+    if(!m_File)
+        return;
+    pthread_mutex_lock(&m_Lock);
+    m_Quit=true;
+    pthread_cond_signal(&m_Queued);
+    pthread_mutex_unlock(&m_Lock);
+    pthread_join(m_Thread,NULL);
+    fclose(m_File);
+    m_File=NULL;
+}
+
+//Writer thread: takes whatever is queued and appends it, the lock is not held while writing
+void *Archive::writer(void *p)
+{
+    Archive *a=(Archive *)p;
+    std::vector<double> buf;
+
+    pthread_mutex_lock(&a->m_Lock);
+    while(true)
+    {
+        while(a->m_Queue.empty() && !a->m_Quit)
+            pthread_cond_wait(&a->m_Queued,&a->m_Lock);
+        if(a->m_Queue.empty())
+            break; //quit once everything is written
+        buf.assign(a->m_Queue.begin(),a->m_Queue.end());
+        a->m_Queue.clear();
+        pthread_mutex_unlock(&a->m_Lock);
+        fwrite(&buf[0],sizeof(double),buf.size(),a->m_File);
+        fflush(a->m_File);
+        pthread_mutex_lock(&a->m_Lock);
+    }
+    pthread_mutex_unlock(&a->m_Lock);
+    return NULL;
+}
+
+//Read the records, a record cut short by an interrupted run is left out
+bool Archive::read(const char *filename,const std::vector<std::wstring>& alleles,const std::vector<std::string>& experiments,
+                   std::vector<Record>& records)
+{
+    std::string h=header(alleles,experiments);
+    std::string existing(h.size(),'\0');
+    std::vector<double> buf(2+alleles.size()+experiments.size());
+    FILE *f=fopen(filename,"rb");
+
+    records.clear();
+    if(!f)
+        return false;
+    if(fread(&existing[0],1,h.size(),f)!=h.size() || existing!=h)
+    {
+        fclose(f);
+        return false;
+    }
+    while(fread(&buf[0],sizeof(double),buf.size(),f)==buf.size())
+    {
+        Record r;
+
+        r.fitness=buf[0];
+        r.seconds=buf[1];
+        r.alleles.assign(buf.begin()+2,buf.begin()+2+alleles.size());
+        r.residuals.assign(buf.begin()+2+alleles.size(),buf.end());
+        records.push_back(r);
+    }
+    fclose(f);
+    return true;
+}
@@ -0,0 +1,57 @@
+//Archive class appends every genome evaluated to a binary file
+//writing happens on a background thread, the file can be read back to warm start a run
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+
+//The file starts with a header naming the alleles and the experiments,
+//records are appended to a file only if the header is the same:
+//    "VXARCH01", int alleles, int experiments,
+//    a name per allele and experiment as an int length and UTF-8 bytes
+//every record is then a fixed number of native doubles:
+//    fitness, seconds, allele values, residual of every experiment (INFINITY if not known)
+class Archive
+{
+    public:
+        //Record - a genome evaluated
+        struct Record
+        {
+            double fitness;
+            double seconds; //time the evaluation took
+            std::vector<double> alleles; //in the order of the alleles of the header
+            std::vector<double> residuals; //per experiment
+        };
+
+        Archive();
+        ~Archive();
+
+        //start appending to the file, alleles and experiments make the header
+        //false if the file cannot be opened or has a different header
+        bool open(const char *filename,const std::vector<std::wstring>& alleles,const std::vector<std::string>& experiments);
+        void write(double fitness,double seconds,const std::vector<double>& alleles,const std::vector<double>& residuals); //queue the record
+        void close(); //write the records queued and stop the writer
+
+        //read the records of the file with the header, false if it cannot be read or the header differs
+        static bool read(const char *filename,const std::vector<std::wstring>& alleles,const std::vector<std::string>& experiments,
+                         std::vector<Record>& records);
+
+    private:
+        static void *writer(void *p);
+        static std::string header(const std::vector<std::wstring>& alleles,const std::vector<std::string>& experiments);
+
+        FILE *m_File;
+        int m_Size; //doubles per record
+        pthread_mutex_t m_Lock;
+        pthread_cond_t m_Queued; //signalled when a record is queued or on close
+        pthread_t m_Thread;
+        std::deque<double> m_Queue; //records queued, m_Size values each
+        bool m_Quit;
+};
+
+#endif
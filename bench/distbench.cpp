@@ -0,0 +1,244 @@
+//Distributor throughput benchmark on synthetic workloads
+//
+//Rank 0 pushes workitems whose evaluation times follow a given distribution through the Distributor,
+//the rest of ranks sleep for the time of every workitem they are sent instead of evaluating experiments.
+//Every batch size is run on the same workitems, the number of ranks is that of the launch, e.g.
+//    mpicxx -o distbench bench/distbench.cpp distributor.cpp utils.cpp -I.
+//    for n in 1 2 5 9; do mpirun -np $n ./distbench -d lognormal -b 1,2,4 -o dist.jsonl; done
+//Results are appended to the output file as JSON Lines, a line per batch size.
+#include <mpi.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <vector>
+#include "distributor.h"
+#include "utils.h"
+
+
+//Workitem data: the time the evaluation takes, seconds
+#define DATA_DURATION 0
+#define DATA_SIZE 1
+
+static double timeout=0.0; //evaluations are given up after that many seconds, 0 for none
+
+//Stand-in for the evaluation: sleep for the duration of every workitem of the request
+//a workitem exceeding the timeout is given up at the timeout and fails
+void do_compute(std::vector<double>& request,std::vector<double>& reply)
+{
+    int block=REQ_HEADER+DATA_SIZE;
+    int count=request.size()/block;
+
+    reply.resize(count*REP_SIZE);
+    for(int i=0;i<count;i++)
+    {
+        double d=request[i*block+REQ_HEADER+DATA_DURATION];
+        bool failed=(timeout>0.0 && d>timeout);
+
+        usleep((useconds_t)((failed?timeout:d)*1e6));
+        reply[i*REP_SIZE+REP_ANSWER]=(failed?INFINITY:d);
+        reply[i*REP_SIZE+REP_BOUNDED]=0.0;
+        reply[i*REP_SIZE+REP_HITS]=0.0;
+        reply[i*REP_SIZE+REP_SECONDS]=0.0;
+    }
+}
+
+//Worker loop, returns when quit command is received from the master
+static void run_worker()
+{
+    MPI_Status stat;
+    std::vector<double> msg,reply;
+
+    while(1)
+    {
+        int count;
+
+        MPI_Probe(MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,&stat);
+        if(stat.MPI_TAG==TAG_QUIT)
+        {
+            MPI_Recv(&count,1,MPI_INT,0,TAG_QUIT,MPI_COMM_WORLD,&stat);
+            break;
+        }
+        MPI_Get_count(&stat,MPI_DOUBLE,&count);
+        msg.resize(count);
+        MPI_Recv(&msg[0],msg.size(),MPI_DOUBLE,0,0,MPI_COMM_WORLD,&stat);
+        do_compute(msg,reply);
+        MPI_Send(&reply[0],reply.size(),MPI_DOUBLE,0,0,MPI_COMM_WORLD);
+    }
+}
+
+//standard normal deviate, Box-Muller
+static double normal()
+{
+    double u=rnd_generate(1e-12,1.0),v=rnd_generate(0.0,1.0);
+
+    return sqrt(-2.0*log(u))*cos(2.0*M_PI*v);
+}
+
+//Duration of a workitem drawn from the distribution of mean m
+//lognormal has the shape sigma s, heavy is Pareto of the index s (heavier the closer it is to 1)
+static double draw(const char *dist,double m,double s)
+{
+    if(!strcmp(dist,"lognormal"))
+        return exp(log(m)-0.5*s*s+s*normal());
+    if(!strcmp(dist,"heavy"))
+    {
+        double alpha=(s>1.0?s:1.5);
+        return m*(alpha-1.0)/alpha/pow(rnd_generate(1e-12,1.0),1.0/alpha);
+    }
+    return m;
+}
+
+static int completed=0;
+
+bool observer(WorkItem *w,double answer,void *p)
+{
+    completed++;
+    return true;
+}
+
+static double cpu_time()
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF,&ru);
+    return ru.ru_utime.tv_sec+1e-6*ru.ru_utime.tv_usec+ru.ru_stime.tv_sec+1e-6*ru.ru_stime.tv_usec;
+}
+
+//Comma separated list of integers
+static void parse_list(const char *s,std::vector<int>& v)
+{
+    v.clear();
+    while(*s)
+    {
+        v.push_back(atoi(s));
+        s=strchr(s,',');
+        if(!s)
+            break;
+        s++;
+    }
+}
+
+void usage(const char *name)
+{
+    printf("Usage: %s [-d distribution] [-m mean] [-s shape] [-t timeout] [-n items] [-b batches] [-r seed] [-o jsonl]\n",name);
+    printf("Where -d picks constant (default), lognormal or heavy evaluation times\n");
+    printf("      -m sets the mean evaluation time in milliseconds, 10 by default\n");
+    printf("      -s sets the sigma of lognormal, the Pareto index of heavy (1.5 by default)\n");
+    printf("      -t sets the time in milliseconds evaluations are given up at, none by default\n");
+    printf("      -n sets the number of workitems, 1000 by default\n");
+    printf("      -b sets a comma separated list of batch sizes, 1 by default\n");
+    printf("      -r seeds the random number generator, 1 by default\n");
+    printf("      -o appends the results to the file as JSON Lines\n");
+}
+
+int main(int argc,char *argv[])
+{
+    const char *dist="constant";
+    const char *output=NULL;
+    double mean=0.010,shape=1.0;
+    int items=1000,seed=1;
+    std::vector<int> batches;
+    int proc,nproc;
+
+    MPI_Init(&argc,&argv);
+    MPI_Comm_rank(MPI_COMM_WORLD,&proc);
+    MPI_Comm_size(MPI_COMM_WORLD,&nproc);
+    parse_list("1",batches);
+    for(int i=1;i<argc;i++)
+    {
+        if(!strcmp(argv[i],"-d") && i+1<argc)
+            dist=argv[++i];
+        else if(!strcmp(argv[i],"-m") && i+1<argc)
+            mean=1e-3*atof(argv[++i]);
+        else if(!strcmp(argv[i],"-s") && i+1<argc)
+            shape=atof(argv[++i]);
+        else if(!strcmp(argv[i],"-t") && i+1<argc)
+            timeout=1e-3*atof(argv[++i]);
+        else if(!strcmp(argv[i],"-n") && i+1<argc)
+            items=atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-b") && i+1<argc)
+            parse_list(argv[++i],batches);
+        else if(!strcmp(argv[i],"-r") && i+1<argc)
+            seed=atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-o") && i+1<argc)
+            output=argv[++i];
+        else
+        {
+            if(!proc)
+                usage(argv[0]);
+            MPI_Finalize();
+            return -1;
+        }
+    }
+
+    if(proc)
+    {
+        run_worker();
+        MPI_Finalize();
+        return 0;
+    }
+
+    //the same workitems for every batch size
+    std::vector<double> durations(items);
+    double work=0.0; //seconds of evaluation, timeouts cut short
+    int failures=0;
+    srand(seed);
+    for(int i=0;i<items;i++)
+    {
+        durations[i]=draw(dist,mean,shape);
+        if(timeout>0.0 && durations[i]>timeout)
+            failures++;
+        work+=((timeout>0.0 && durations[i]>timeout)?timeout:durations[i]);
+    }
+
+    FILE *f=(output?fopen(output,"a"):NULL);
+    int workers=nproc; //the master evaluates a workitem itself whenever all the ranks are busy
+
+    printf("%-10s %5s %5s %6s %11s %8s %12s %14s\n","Dist","Ranks","Batch","Items","Makespan(s)","Idle","MasterCPU(s)","Latency(ms)");
+    for(int b=0;b<batches.size();b++)
+    {
+        Distributor& d=Distributor::instance();
+
+        d.batch(batches[b]);
+        d.reset_stats();
+        for(int i=0;i<items;i++)
+        {
+            WorkItem *w=d.get(DATA_SIZE);
+
+            w->key=i;
+            w->data[DATA_DURATION]=durations[i];
+            d.push(w);
+        }
+
+        completed=0;
+        double cpu=cpu_time();
+        double started=monotonic_time();
+        d.process(observer,NULL);
+        double makespan=monotonic_time()-started;
+        cpu=cpu_time()-cpu;
+
+        //rank busy time is counted from sending to receiving, what exceeds the work is the cost of dispatching
+        const Distributor::Stats& s=d.stats();
+        double busy=0.0;
+        for(int i=0;i<s.busy.size();i++)
+            busy+=s.busy[i];
+        double idle=1.0-work/(workers*makespan);
+        double latency=(busy-work)/items;
+
+        printf("%-10s %5d %5d %6d %11.3f %8.4f %12.3f %14.4f\n",dist,nproc,batches[b],completed,makespan,idle,cpu,1e3*latency);
+        if(f)
+            fprintf(f,"{\"distribution\":\"%s\",\"mean_ms\":%g,\"shape\":%g,\"timeout_ms\":%g,\"ranks\":%d,\"batch\":%d,"
+                      "\"items\":%d,\"failures\":%d,\"work\":%.6f,\"makespan\":%.6f,\"idle\":%.6f,\"master_cpu\":%.6f,"
+                      "\"latency_ms\":%.6f}\n",
+                    dist,1e3*mean,shape,1e3*timeout,nproc,batches[b],completed,failures,work,makespan,idle,cpu,1e3*latency);
+    }
+    if(f)
+        fclose(f);
+
+    Distributor::instance().finish();
+    MPI_Finalize();
+    return 0;
+}
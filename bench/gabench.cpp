@@ -0,0 +1,351 @@
+//GA engine benchmark on synthetic fitness functions
+//
+//Runs GAEngine with an in-process do_compute evaluating a synthetic function instead of
+//the virtual experiments, to measure the overhead of the engine and how quickly it converges.
+//Built from the sources of the application except experiment.cpp, e.g.
+//    mpicxx -o gabench bench/gabench.cpp distributor.cpp virtexp.cpp nativemodel.cpp odesolver.cpp
+//           threadpool.cpp telemetry.cpp archive.cpp profile.cpp utils.cpp -I. <CellML API flags> -ldl -lpthread
+//and run on a single rank, so that the master evaluates every genome itself.
+#include <mpi.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <set>
+#include "GAEngine.h"
+#include "distributor.h"
+#include "utils.h"
+
+
+ObjRef<iface::cellml_api::CellMLBootstrap> bootstrap; //unused, virtexp.cpp refers to them
+ObjRef<iface::cellml_services::CellMLIntegrationService> cis;
+int verbosity=0;
+
+//Synthetic fitness functions, minimal at 0
+static double rosenbrock(const double *x,int n)
+{
+    double f=0.0;
+    for(int i=0;i+1<n;i++)
+        f+=100.0*(x[i+1]-x[i]*x[i])*(x[i+1]-x[i]*x[i])+(1.0-x[i])*(1.0-x[i]);
+    return f;
+}
+
+static double rastrigin(const double *x,int n)
+{
+    double f=10.0*n;
+    for(int i=0;i<n;i++)
+        f+=x[i]*x[i]-10.0*cos(2.0*M_PI*x[i]);
+    return f;
+}
+
+static double ackley(const double *x,int n)
+{
+    double s=0.0,c=0.0;
+    for(int i=0;i<n;i++)
+    {
+        s+=x[i]*x[i];
+        c+=cos(2.0*M_PI*x[i]);
+    }
+    return -20.0*exp(-0.2*sqrt(s/n))-exp(c/n)+20.0+M_E;
+}
+
+static int cost_usec=1000; //emulated cost of an evaluation
+
+//sphere function taking cost_usec to evaluate, emulating the cost of a model
+static double sleeper(const double *x,int n)
+{
+    double f=0.0;
+    usleep(cost_usec);
+    for(int i=0;i<n;i++)
+        f+=x[i]*x[i];
+    return f;
+}
+
+typedef double (*FUNCTION)(const double *x,int n);
+
+static const struct { const char *name; FUNCTION f; double lower,upper; } functions[]=
+{
+    { "rosenbrock", rosenbrock, -2.048, 2.048 },
+    { "rastrigin", rastrigin, -5.12, 5.12 },
+    { "ackley", ackley, -32.768, 32.768 },
+    { "sleep", sleeper, -5.0, 5.0 }
+};
+#define FUNCTIONS (sizeof(functions)/sizeof(functions[0]))
+
+//State of the current run, kept by the do_compute stand-in
+static FUNCTION function=NULL;
+static int alleles=0;
+static int population=0;
+static int evaluations=0;
+static double best=INFINITY;
+static double compute_time=0.0; //seconds spent evaluating
+static std::vector<std::pair<int,double> > convergence; //best fitness after every population-worth of evaluations
+
+//Screening check: with early abort the screening bound is the worst survivor times 1+margin,
+//every offspring screened within it must be evaluated at full accuracy later on
+static double margin=0.0; //screen margin, 0 not to screen
+static bool early=false; //early abort
+static double worst=INFINITY; //worst survivor the offspring are bred from
+static std::vector<std::vector<double> > promising; //offspring screened within the margin
+static std::set<std::vector<double> > confirmed; //genomes evaluated at full accuracy
+
+
+bool observer(WorkItem *w,double answer,void *g)
+{
+    GAEngine<COMP_FUNC> *ga=(GAEngine<COMP_FUNC> *)g;
+
+    ga->process_workitem(w,answer);
+    return true;
+}
+
+//Stand-in for the evaluation of the experiments: every block of the request is a genome
+void do_compute(std::vector<double>& request,std::vector<double>& reply)
+{
+    double started=monotonic_time();
+    int block=REQ_HEADER+alleles;
+    int count=request.size()/block;
+
+    reply.resize(count*REP_SIZE);
+    for(int i=0;i<count;i++)
+    {
+        const double *x=&request[i*block+REQ_HEADER];
+        double f=function(x,alleles);
+        double threshold=request[i*block+REQ_THRESHOLD];
+
+        //screening is exact here, the evaluation is aborted past the threshold
+        if(request[i*block+REQ_FIDELITY]==FIDELITY_FULL)
+            confirmed.insert(std::vector<double>(x,x+alleles));
+        else if(f<=worst*(1.0+margin))
+            promising.push_back(std::vector<double>(x,x+alleles));
+        reply[i*REP_SIZE+REP_ANSWER]=f;
+        reply[i*REP_SIZE+REP_BOUNDED]=(f>threshold?1.0:0.0);
+        reply[i*REP_SIZE+REP_HITS]=0.0;
+        reply[i*REP_SIZE+REP_SECONDS]=0.0;
+        if(f<best)
+            best=f;
+        if(++evaluations%population==0)
+            convergence.push_back(std::make_pair(evaluations,best));
+    }
+    compute_time+=monotonic_time()-started;
+}
+
+//Result of a run
+struct Result
+{
+    const char *function;
+    int population;
+    int alleles;
+    int generations;
+    int evaluations;
+    double seconds;
+    double overhead; //seconds per generation not spent evaluating
+    double best;
+    int unconfirmed; //offspring screened within the margin never evaluated at full accuracy
+    std::vector<std::pair<int,double> > convergence;
+};
+
+//Run the engine on the function i
+static Result run(int i,int pop,int n,int generations)
+{
+    GAEngine<COMP_FUNC> ga;
+    Result r;
+
+    function=functions[i].f;
+    alleles=n;
+    population=pop;
+    evaluations=0;
+    best=INFINITY;
+    compute_time=0.0;
+    convergence.clear();
+    promising.clear();
+    confirmed.clear();
+    worst=INFINITY;
+
+    ga.prob_cross()=0.5;
+    ga.prob_mutate()=0.1;
+    ga.part_cross()=(int)(pop*0.5);
+    ga.part_mutate()=(int)(pop*0.1);
+    ga.screen_margin()=margin;
+    ga.early_abort()=early;
+    for(int k=0;k<n;k++)
+    {
+        char name[32];
+
+        sprintf(name,"x%d",k);
+        ga.AddAllele(convert(std::string(name)));
+        ga.AddLimit(convert(std::string(name)),functions[i].lower,functions[i].upper);
+    }
+    ga.set_borders(pop);
+    ga.Initialise();
+
+    double started=monotonic_time();
+    if(margin<=0.0)
+        ga.RunGenerations(generations);
+    else
+    {
+        //the population is sampled after every phase, that before the offspring are bred is the survivors
+        ga.Start(generations);
+        while(ga.Advance())
+        {
+            std::vector<VariablesHolder> v;
+
+            Distributor::instance().process(observer,&ga);
+            ga.sample(pop,v);
+            worst=-INFINITY;
+            for(int k=0;k<v.size();k++)
+            {
+                std::vector<double> x;
+
+                for(int j=0;j<v[k].size();j++)
+                    x.push_back(v[k](v[k].id(j)));
+                worst=std::max(worst,function(&x[0],n));
+            }
+        }
+    }
+    r.seconds=monotonic_time()-started;
+
+    r.function=functions[i].name;
+    r.population=pop;
+    r.alleles=n;
+    r.generations=generations;
+    r.evaluations=evaluations;
+    r.overhead=(r.seconds-compute_time)/(generations+1); //the initial population is a generation too
+    r.best=best;
+    r.unconfirmed=0;
+    for(int k=0;k<promising.size();k++)
+        r.unconfirmed+=!confirmed.count(promising[k]);
+    r.convergence=convergence;
+    return r;
+}
+
+//Comma separated list of integers
+static void parse_list(const char *s,std::vector<int>& v)
+{
+    v.clear();
+    while(*s)
+    {
+        v.push_back(atoi(s));
+        s=strchr(s,',');
+        if(!s)
+            break;
+        s++;
+    }
+}
+
+static void write_json(FILE *f,std::vector<Result>& results)
+{
+    fprintf(f,"{\"benchmarks\":[\n");
+    for(int i=0;i<results.size();i++)
+    {
+        Result& r=results[i];
+
+        fprintf(f,"  {\"function\":\"%s\",\"population\":%d,\"alleles\":%d,\"generations\":%d,"
+                  "\"evaluations\":%d,\"seconds\":%.6f,\"evaluations_per_second\":%.1f,"
+                  "\"overhead_per_generation_ms\":%.6f,\"best\":%.17g,\"unconfirmed\":%d,\"convergence\":[",
+                r.function,r.population,r.alleles,r.generations,r.evaluations,r.seconds,
+                (r.seconds>0.0?r.evaluations/r.seconds:0.0),1e3*r.overhead,r.best,r.unconfirmed);
+        for(int k=0;k<r.convergence.size();k++)
+            fprintf(f,"%s[%d,%.17g]",(k?",":""),r.convergence[k].first,r.convergence[k].second);
+        fprintf(f,"]}%s\n",(i+1<results.size()?",":""));
+    }
+    fprintf(f,"]}\n");
+}
+
+void usage(const char *name)
+{
+    printf("Usage: %s [-f function[,function...]] [-g generations] [-p populations] [-n alleles] [-c usec] [-m margin [-e]] [-s seed] [-o json]\n",name);
+    printf("Where -f picks the functions out of rosenbrock, rastrigin, ackley and sleep, all of them by default\n");
+    printf("      -g sets the number of generations, 100 by default\n");
+    printf("      -p sets a comma separated list of population sizes, 50,200 by default\n");
+    printf("      -n sets a comma separated list of allele counts, 5,20 by default\n");
+    printf("      -c sets the cost of an evaluation of the sleep function in microseconds, 1000 by default\n");
+    printf("      -m screens the offspring with the margin, checking that those within it are confirmed\n");
+    printf("      -e aborts evaluations past the worst survivor\n");
+    printf("      -s seeds the random number generator, 1 by default\n");
+    printf("      -o writes the results as JSON to the file\n");
+}
+
+int main(int argc,char *argv[])
+{
+    const char *names=NULL;
+    const char *output=NULL;
+    int generations=100;
+    std::vector<int> pops,counts;
+    std::vector<Result> results;
+    int seed=1;
+    bool failed=false;
+
+    MPI_Init(&argc,&argv);
+    parse_list("50,200",pops);
+    parse_list("5,20",counts);
+    for(int i=1;i<argc;i++)
+    {
+        if(!strcmp(argv[i],"-f") && i+1<argc)
+            names=argv[++i];
+        else if(!strcmp(argv[i],"-g") && i+1<argc)
+            generations=atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-p") && i+1<argc)
+            parse_list(argv[++i],pops);
+        else if(!strcmp(argv[i],"-n") && i+1<argc)
+            parse_list(argv[++i],counts);
+        else if(!strcmp(argv[i],"-c") && i+1<argc)
+            cost_usec=atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-m") && i+1<argc)
+            margin=atof(argv[++i]);
+        else if(!strcmp(argv[i],"-e"))
+            early=true;
+        else if(!strcmp(argv[i],"-s") && i+1<argc)
+            seed=atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-o") && i+1<argc)
+            output=argv[++i];
+        else
+        {
+            usage(argv[0]);
+            MPI_Finalize();
+            return -1;
+        }
+    }
+
+    printf("%-12s %6s %7s %9s %10s %12s %14s\n","Function","Pop","Alleles","Evals","Evals/s","Overhead(ms)","Best");
+    for(int i=0;i<FUNCTIONS;i++)
+    {
+        if(names && !strstr(names,functions[i].name))
+            continue;
+        for(int p=0;p<pops.size();p++)
+        {
+            for(int n=0;n<counts.size();n++)
+            {
+                srand(seed);
+                Result r=run(i,pops[p],counts[n],generations);
+
+                printf("%-12s %6d %7d %9d %10.1f %12.4f %14.6g\n",r.function,r.population,r.alleles,r.evaluations,
+                       (r.seconds>0.0?r.evaluations/r.seconds:0.0),1e3*r.overhead,r.best);
+                if(r.unconfirmed)
+                {
+                    fprintf(stderr,"%d offspring screened within the margin were never confirmed\n",r.unconfirmed);
+                    failed=true;
+                }
+                results.push_back(r);
+            }
+        }
+    }
+
+    if(output)
+    {
+        FILE *f=fopen(output,"w");
+
+        if(f)
+        {
+            write_json(f,results);
+            fclose(f);
+        }
+        else
+            fprintf(stderr,"Error creating %s\n",output);
+    }
+
+    MPI_Finalize();
+    return (failed?1:0);
+}
@@ -8,19 +8,32 @@
 #include "cellml-api-cxx-support.hpp"
 #include "IfaceCellML_APISPEC.hxx"
 #include "CellMLBootstrap.hpp"
+#include "IfaceCIS.hxx"
 #include <string>
 #include "utils.h"
 
 
+//Interface to inspect the results while the integration is still running
+//examine is called for every record as it arrives from the solver,
+//returning false requests the integration to be aborted
+class ResultsMonitor
+{
+public:
+  virtual ~ResultsMonitor() {}
+  virtual bool examine(const double *rec,int recsize)=0;
+};
+
+
 class LocalProgressObserver:public iface::cellml_services::IntegrationProgressObserver
 {
 public:
   LocalProgressObserver(iface::cellml_services::CellMLCompiledModel* aCCM)
-    : mRefcount(1), bFinished(false),bFailed(false)
+    : mRefcount(1), bFinished(false),bFailed(false),bAborted(false),pMonitor(NULL),nExamined(0)
   {
     mCCM = aCCM;
     mCCM->add_ref();
     mCI = mCCM->codeInformation();
+    nRecSize = 2 * mCI->rateIndexCount() + mCI->algebraicIndexCount() + 1;
 
     iface::cellml_services::ComputationTargetIterator* cti =
       mCI->iterateTargets();
@@ -45,6 +58,7 @@ public:
 
   ~LocalProgressObserver()
   {
+    delete pMonitor;
     mCCM->release_ref();
     mCI->release_ref();
   }
@@ -120,6 +134,17 @@ virtual std::vector<std::string> supported_interfaces() throw (std::exception&)
     throw (std::exception&)
   {
       m_Results.insert(m_Results.end(),results.begin(),results.end());
+      if(!pMonitor || bAborted)
+        return;
+      //pass complete records to the monitor
+      for(;nExamined+nRecSize<=m_Results.size();nExamined+=nRecSize)
+      {
+        if(!pMonitor->examine(&m_Results[nExamined],nRecSize))
+        {
+          bAborted=true;
+          break;
+        }
+      }
   }
 
 //Public interface to the observer data
@@ -157,6 +182,12 @@ virtual std::vector<std::string> supported_interfaces() throw (std::exception&)
 //true if compute is done
   bool finished() const { return bFinished; }
   bool failed() const { return bFailed; }
+//true if the monitor requested to abort the computations
+  bool aborted() const { return bAborted; }
+
+//Attach monitor to examine the results as they arrive
+//the observer takes ownership of the monitor
+  void monitor(ResultsMonitor *m) { pMonitor=m; }
 
 private:
   iface::cellml_services::CellMLCompiledModel* mCCM;
@@ -164,6 +195,10 @@ private:
   uint32_t mRefcount;
   bool bFinished;
   bool bFailed;
+  volatile bool bAborted;
+  ResultsMonitor *pMonitor;
+  uint32_t nRecSize;
+  size_t nExamined;
   std::vector<double> m_Results;
 };
 
@@ -3,12 +3,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <algorithm>
 #include "distributor.h"
+#include "utils.h"
 
 using namespace std;
 
 
-double do_compute(std::vector<double>& vals);
+void do_compute(std::vector<double>& request,std::vector<double>& reply);
 
 
 //Singleton support to ensure the only instance of the distributor to exist
@@ -20,7 +22,7 @@ Distributor& Distributor::instance()
 }
 
 //Distributor constructor
-Distributor::Distributor()
+Distributor::Distributor():turn(0),in_process(0),nparts(0),nbatch(1),affine(false)
 {
     int nproc;
     
@@ -31,17 +33,112 @@ Distributor::Distributor()
     {
         ranks[i].first=false; //mark all tasks to be not busy
     }
+    sent.resize(nproc,0.0);
+    counters.busy.resize(nproc,0.0);
+}
+
+//Start counting the work processed afresh
+void Distributor::reset_stats()
+{
+    counters=Stats();
+    counters.busy.resize(ranks.size(),0.0);
 }
 
 Distributor::~Distributor()
 {
+    for(int i=0;i<pool.size();i++)
+        delete pool[i];
+}
+
+//Take a workitem from the pool, or allocate one if the pool is empty
+//the data of a recycled workitem keeps its capacity
+WorkItem *Distributor::get(int size)
+{
+    WorkItem *w;
+
+    if(pool.empty())
+        w=new WorkItem;
+    else
+    {
+        w=pool.back();
+        pool.pop_back();
+        w->key=0;
+        w->job=0;
+        w->context=0;
+        w->threshold=INFINITY;
+        w->bounded=false;
+        w->hits=0;
+        w->seconds=0.0;
+        w->elapsed=0.0;
+        w->residuals.clear();
+        w->part=-1;
+        w->fidelity=0;
+        w->solver=-1;
+        w->parent=NULL;
+    }
+    w->data.resize(size);
+    return w;
+}
+
+//Return a workitem to the pool
+void Distributor::release(WorkItem *item)
+{
+    pool.push_back(item);
 }
 
 
 //Add a work item for further processing
+//when splitting, a part is queued for every experiment instead
 void Distributor::push(WorkItem* item)
 {
-    witems.push_back(item);
+    if(item->job>=open.size())
+    {
+        open.resize(item->job+1,0);
+        queued.resize(item->job+1,0);
+    }
+    if(!item->parent)
+        open[item->job]++;
+    if(!nparts || item->part>=0)
+    {
+        witems.push_back(item);
+        queued[item->job]++;
+        return;
+    }
+    partials[item].pending=nparts;
+    item->residuals.assign(nparts,INFINITY);
+    item->seconds=0.0;
+    for(int i=0;i<nparts;i++)
+    {
+        WorkItem *w=get(item->data.size());
+
+        w->key=item->key;
+        w->job=item->job;
+        w->fidelity=item->fidelity;
+        w->solver=item->solver;
+        std::copy(item->data.begin(),item->data.end(),w->data.begin());
+        w->part=i;
+        w->parent=item;
+        //a single residual exceeding the total makes the average exceed the threshold
+        w->threshold=item->threshold*nparts;
+        witems.push_back(w);
+        queued[item->job]++;
+    }
+}
+
+//Experiments are dealt out to the worker ranks: with more workers than experiments
+//every experiment is owned by a group of ranks, otherwise every rank owns several experiments
+//without affinity every rank may evaluate anything
+bool Distributor::owns(int rank,int part)
+{
+    int workers=ranks.size()-1;
+
+    if(!affined() || part<0)
+        return true;
+    if(rank<1)
+        return false;
+    if(workers>=nparts)
+        return ((rank-1)%nparts==part);
+    return (part%workers==rank-1);
 }
 
 //returns number of workitems registered
@@ -50,12 +147,32 @@ int Distributor::count()
     return witems.size();
 }
 
-void Distributor::remove_key(int key)
+//workitems of the job the observer has not been called for yet
+int Distributor::outstanding(int job)
+{
+    return (job>=0 && job<open.size()?open[job]:0);
+}
+
+//the workitems removed return to the pool, with the workitem the parts were split from
+void Distributor::remove_key(int key,int job)
 {
     for(WORKITEMS::iterator it=witems.begin();it!=witems.end();)
     {
-        if((*it)->key==key)
+        if((*it)->key==key && (*it)->job==job)
+        {
+            WorkItem *parent=(*it)->parent;
+
+            if(!parent)
+                open[job]--;
+            else if(partials.erase(parent))
+            {
+                open[job]--;
+                release(parent);
+            }
+            queued[job]--;
+            release(*it);
             it=witems.erase(it);
+        }
         else
             ++it;
     }
@@ -66,39 +183,96 @@ void Distributor::remove_key(int key)
 //p is a context passed to observer and is transparent for the distributor
 void Distributor::process(Distributor::OBSERVER o,void *p)
 {
-    int in_process=0;
+    run(o,p,false);
+    done.clear();
+}
 
+//Process registered workitems until all those of a job are done
+//the workitems of the other jobs may still be evaluated by the ranks when it returns
+//returns the job, or -1 if there is nothing left to process
+int Distributor::process_any(Distributor::OBSERVER o,void *p)
+{
+    if(done.empty())
+        run(o,p,true);
+    if(done.empty())
+        return -1;
 
-    while(witems.size())
+    int job=done.front();
+    done.pop_front();
+    return job;
+}
+
+//Send workitems to the ranks and pass the replies to the observer
+//returns once everything is processed, or once a job is done if any is set
+void Distributor::run(Distributor::OBSERVER o,void *p,bool any)
+{
+    double started=monotonic_time();
+    double waited=0.0;
+
+
+    while(witems.size() && !(any && done.size()))
     {
         int i=1;
-
-        //get next workitem for processing
-        WorkItem *workitem=witems.front();
-        witems.pop_front();
+        WORKITEMS::iterator it;
 
         //find a rank to send the workitem to
         for(;i<ranks.size();i++)
-            if(!ranks[i].first)
+            if(!ranks[i].first && (it=first(i))!=witems.end())
                break; //found available rank
         
         //check if an available rank is found
         if(i<ranks.size())
         {
+            //batch size, small enough to leave work for the rest of ranks
+            int size=witems.size()/(ranks.size()-1);
+            if(size>nbatch)
+                size=nbatch;
+
             ranks[i].first=true; //Found available rank
-            ranks[i].second=workitem;
-            workitem->context=time(NULL); //save time for adding load balancing later
+            ranks[i].second.clear();
+            turn=(*it)->job;
+            do
+            {
+                //get next workitem of the job for processing
+                WorkItem *workitem=*it;
+                it=next(i,turn,witems.erase(it));
+                queued[turn]--;
+                workitem->context=time(NULL); //save time for adding load balancing later
+                ranks[i].second.push_back(workitem);
+            }
+            while(it!=witems.end() && ranks[i].second.size()<size);
             //Request processing
-            MPI_Send(&workitem->data[0],workitem->data.size(),MPI_DOUBLE,i,0,MPI_COMM_WORLD);
+            send(i);
             in_process++;
         }
+        else if(affined())
+        {
+            MPI_Status stat;
+            int r;
+            double t=monotonic_time();
+
+            //the ranks owning what is left are busy, wait for one of them
+            MPI_Probe(MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,&stat);
+            waited+=monotonic_time()-t;
+            r=receive(o,p,stat);
+            ranks[r].first=false;
+            in_process--;
+        }
         else
         {
             //we are the only one available - do compute
-            double answer;
+            it=first(0);
+            turn=(*it)->job;
+            queued[turn]--;
+            local.assign(1,*it);
+            witems.erase(it);
 
-            answer=do_compute(workitem->data); // compute this workitem's data, returns the residual
-            o(workitem,answer,p); //call observer
+            double t=monotonic_time();
+            pack(local);
+            do_compute(msg,reply); // compute this workitem's data, returns the residual
+            t=monotonic_time()-t;
+            counters.busy[0]+=t;
+            unpack(local,&reply[0],t,o,p); //call observer
             //get data back
             if(in_process)
             {
@@ -113,9 +287,7 @@ void Distributor::process(Distributor::OBSERVER o,void *p)
                     if(flag)
                     {
                         //There is data available
-		        r=stat.MPI_SOURCE;
-		        MPI_Recv(&answer,1,MPI_DOUBLE,stat.MPI_SOURCE,0,MPI_COMM_WORLD,&stat);
-		        o(ranks[r].second,answer,p);                 
+		        r=receive(o,p,stat);
 		        ranks[r].first=false;
 		        in_process--;
                     }
@@ -126,22 +298,152 @@ void Distributor::process(Distributor::OBSERVER o,void *p)
         }
     }
     //all done - wait for the rest if anything left
-    while(in_process)
+    while(in_process && !(any && done.size()))
     {
 	MPI_Status stat;
 	int r;
-        double answer;
+	double t=monotonic_time();
 
         //Wait until someting is returned - can be ommitted
 	MPI_Probe(MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,&stat);
-	r=stat.MPI_SOURCE;
-	MPI_Recv(&answer,1,MPI_DOUBLE,stat.MPI_SOURCE,0,MPI_COMM_WORLD,&stat);
-	o(ranks[r].second,answer,p);                 
+	waited+=monotonic_time()-t;
+	r=receive(o,p,stat);
 	ranks[r].first=false;
 	in_process--;
     }
+    counters.wait+=waited;
+    counters.dispatch+=monotonic_time()-started-waited;
+}
+
+
+//First workitem of the job from it on the rank may process
+Distributor::WORKITEMS::iterator Distributor::next(int rank,int job,WORKITEMS::iterator it)
+{
+    while(it!=witems.end() && ((*it)->job!=job || !owns(rank,(*it)->part)))
+        ++it;
+    return it;
+}
+
+//First workitem the rank may process, the jobs with workitems queued take turns
+//a job the rank may process nothing of passes its turn on
+Distributor::WORKITEMS::iterator Distributor::first(int rank)
+{
+    for(int k=1;k<=queued.size();k++)
+    {
+        int job=(turn+k)%queued.size();
+
+        if(!queued[job])
+            continue;
+
+        WORKITEMS::iterator it=next(rank,job,witems.begin());
+        if(it!=witems.end())
+            return it;
+    }
+    return witems.end();
+}
+
+//Build the request message: data of every workitem prefixed by the request header
+void Distributor::pack(Distributor::BATCH& b)
+{
+    msg.clear();
+    for(int i=0;i<b.size();i++)
+    {
+        WorkItem *w=b[i];
+        int pos=msg.size();
+
+        msg.resize(pos+REQ_HEADER+w->data.size());
+        msg[pos+REQ_THRESHOLD]=w->threshold;
+        msg[pos+REQ_PART]=w->part;
+        msg[pos+REQ_FIDELITY]=w->fidelity;
+        msg[pos+REQ_SOLVER]=w->solver;
+        std::copy(w->data.begin(),w->data.end(),msg.begin()+pos+REQ_HEADER);
+    }
+}
+
+//Pass the reply blocks to the observer of the workitems of the batch
+//the seconds the batch took are shared evenly by its workitems
+void Distributor::unpack(Distributor::BATCH& b,const double *reply,double seconds,Distributor::OBSERVER o,void *p)
+{
+    for(int i=0;i<b.size();i++,reply+=REP_SIZE)
+    {
+        b[i]->bounded=(reply[REP_BOUNDED]!=0.0);
+        b[i]->seconds=seconds/b.size();
+        b[i]->elapsed=reply[REP_SECONDS];
+        b[i]->hits=(int)reply[REP_HITS];
+        counters.evaluations++;
+        counters.hits+=b[i]->hits;
+        complete(b[i],reply[REP_ANSWER],o,p);
+    }
+}
+
+//Send the batch of the rank for processing
+void Distributor::send(int rank)
+{
+    pack(ranks[rank].second);
+    sent[rank]=monotonic_time();
+    MPI_Send(&msg[0],msg.size(),MPI_DOUBLE,rank,0,MPI_COMM_WORLD);
 }
 
+//Receive a reply which has been probed into stat
+//and pass it to the observer of the workitems that rank was processing
+int Distributor::receive(Distributor::OBSERVER o,void *p,MPI_Status& stat)
+{
+    int r=stat.MPI_SOURCE;
+
+    reply.resize(REP_SIZE*ranks[r].second.size());
+    MPI_Recv(&reply[0],reply.size(),MPI_DOUBLE,r,0,MPI_COMM_WORLD,&stat);
+    double seconds=monotonic_time()-sent[r];
+    counters.busy[r]+=seconds;
+    unpack(ranks[r].second,&reply[0],seconds,o,p);
+    return r;
+}
+
+//Pass the answer to the observer
+//parts are accumulated until all of them are returned, the observer then gets
+//the average residual of the parts or INFINITY if any of them has failed
+void Distributor::complete(WorkItem *w,double answer,Distributor::OBSERVER o,void *p)
+{
+    WorkItem *parent=w->parent;
+
+    if(!parent)
+    {
+        o(w,answer,p);
+        if(!--open[w->job])
+            done.push_back(w->job);
+        release(w);
+        return;
+    }
+
+    Partial& r=partials[parent];
+    if(answer!=INFINITY)
+        r.sum+=answer;
+    else
+        r.failed=true;
+    r.bounded=(r.bounded || w->bounded);
+    parent->residuals[w->part]=answer;
+    parent->seconds+=w->seconds;
+    release(w);
+    if(--r.pending)
+        return;
+
+    //all parts are in
+    //an aborted part makes the sum a lower estimate, unless a part has failed
+    parent->bounded=(r.bounded && !r.failed);
+    answer=(r.failed?INFINITY:r.sum/(double)nparts);
+    partials.erase(parent);
+    o(parent,answer,p);
+    if(!--open[parent->job])
+        done.push_back(parent->job);
+    release(parent);
+}
+
+//Send the data to every worker rank with the tag, the rank gets it before any request sent later
+//the master takes no part, it is up to the caller to apply the data on rank 0
+void Distributor::broadcast(int tag,std::vector<double>& data)
+{
+    for(int i=1;i<ranks.size();i++)
+        MPI_Send((data.empty()?NULL:&data[0]),data.size(),MPI_DOUBLE,i,tag,MPI_COMM_WORLD);
+}
 
 //finalize processing and notifies all the ranks about
 //requested end of service
@@ -5,17 +5,49 @@
 
 #include <vector>
 #include <list>
+#include <map>
+#include <deque>
+#include <math.h>
+#include <mpi.h>
 
 #define TAG_QUIT 0x100
 
+//Layout of a request message: header followed by WorkItem::data
+//a batch request holds a block of that layout for every workitem
+#define REQ_THRESHOLD 0 //fitness bound the evaluation may stop at
+#define REQ_PART 1 //experiment to evaluate, -1 for all of them
+#define REQ_FIDELITY 2 //accuracy to evaluate with
+#define REQ_SOLVER 3 //candidate solver to evaluate with, -1 for the solver of the experiments
+#define REQ_HEADER 4
+
+//Layout of a reply message, a block per workitem of the request
+#define REP_ANSWER 0 //fitness computed
+#define REP_BOUNDED 1 //non-zero if the answer is only a lower bound
+#define REP_HITS 2 //experiments answered from the residual caches
+#define REP_SECONDS 3 //seconds the rank spent evaluating the workitem, 0 if not measured
+#define REP_SIZE 4
+
 
 //Work item - holds information about
 //data to be passed to a compute task
 struct WorkItem
 {
+    WorkItem():key(0),job(0),context(0),threshold(INFINITY),bounded(false),hits(0),seconds(0.0),elapsed(0.0),part(-1),fidelity(0),solver(-1),parent(NULL) {}
+
     int key; //context-dependent value, passed to the observer
+    int job; //search the workitem belongs to when several share the ranks
     int context; //distribution context
+    double threshold; //evaluation is aborted once its fitness exceeds it
+    bool bounded; //set on reply if evaluation was aborted
+    int hits; //set on reply, experiments answered from the residual caches
+    double seconds; //set on reply, share of the time its batch took from sending to reply
+    double elapsed; //set on reply, seconds the rank spent evaluating it
+    int part; //experiment to evaluate, -1 for all of them
+    int fidelity; //accuracy to evaluate with, FIDELITY_FULL or FIDELITY_SCREEN
+    int solver; //candidate solver to evaluate with, -1 for the solver of the experiments
+    WorkItem *parent; //workitem this one is a part of
     std::vector<double> data; //data to be distributed
+    std::vector<double> residuals; //set on reply if split, residual of every part
 };
 
 //Class to handle job distribution via MPI
@@ -23,6 +55,15 @@ struct WorkItem
 //Distributor collects work items to be processed until process() is called
 //process then goes through the ranks filing workitems to them
 //and calls the OBSERVER callback for every result received
+//Workitems are taken from the pool of the distributor by get() and return to it
+//once the observer has been called for them or they are removed
+//If parts are set, every workitem is split into one workitem per experiment,
+//the residuals of the parts are reduced before the observer is called
+//If batch is set, up to that many workitems are sent to a rank in one request
+//If affinity is set as well as parts, every worker rank evaluates a subset of the experiments only
+//and a part is sent to the ranks owning its experiment; the master then computes nothing itself
+//Workitems of several jobs may be queued together, the ranks are then given the work of the jobs in turn
+//and process_any() returns as soon as all the workitems of a job are done
 class Distributor
 {
     private:
@@ -31,18 +72,81 @@ class Distributor
     public:
         typedef bool (*OBSERVER)(WorkItem *,double answer,void *); //observer function to be called for each returned result
 
+        //Stats - work processed since the last reset
+        struct Stats
+        {
+            Stats():evaluations(0),hits(0),dispatch(0.0),wait(0.0) {}
+
+            int evaluations; //workitems (or parts) evaluated
+            int hits; //experiments answered from the residual caches
+            double dispatch; //seconds process() spent other than waiting, computing locally included
+            double wait; //seconds process() spent blocked on replies
+            std::vector<double> busy; //seconds every rank spent evaluating
+        };
+
         static Distributor& instance();
+        WorkItem *get(int size); //workitem from the pool with size data values
+        void release(WorkItem *item); //return the workitem to the pool
         void push(WorkItem* item); //Add new workitem for processing
-        void remove_key(int key); //remove all requests with the specified key
+        void remove_key(int key,int job=0); //remove all requests of the job with the specified key
         int count(); //number of workitems
+        int outstanding(int job); //workitems of the job the observer has not been called for yet
+        void parts(int n) { nparts=n; } //split workitems into n experiments, 0 not to split
+        void batch(int n) { nbatch=(n>1?n:1); } //number of workitems sent to a rank at once
+        void affinity(bool a) { affine=a; } //route parts to the ranks owning their experiments
+        bool owns(int rank,int part); //whether the rank evaluates the experiment part
         void process(OBSERVER o,void *d); //process workitems calling observer o for each result
+        int process_any(OBSERVER o,void *d); //process workitems until those of a job are done, returns the job or -1 if nothing is left
+        void broadcast(int tag,std::vector<double>& data); //send data to every worker rank ahead of its following requests
         void finish(); //terminate MPI chain, must be called before MPI_Finalize
+        const Stats& stats() const { return counters; } //work processed since reset_stats()
+        void reset_stats();
+
+    private:
+        typedef std::vector<WorkItem*> BATCH;
+
+        void pack(BATCH& b); //build request message of the batch in msg
+        void unpack(BATCH& b,const double *reply,double seconds,OBSERVER o,void *d); //pass reply of the batch to the observer
+        void run(OBSERVER o,void *d,bool any); //process workitems, until a job is done if any
+        void send(int rank); //send the batch of the rank for processing
+        int receive(OBSERVER o,void *d,MPI_Status& stat); //receive reply, returns the rank it came from
+        void complete(WorkItem *w,double answer,OBSERVER o,void *d); //reduce parts and call observer
+        std::list<WorkItem*>::iterator next(int rank,int job,std::list<WorkItem*>::iterator it); //first workitem of the job from it the rank may process
+        std::list<WorkItem*>::iterator first(int rank); //first workitem the rank may process of the job next in turn
+        bool affined() { return (affine && nparts && ranks.size()>1); } //parts are routed by affinity
 
     protected:
         typedef std::list<WorkItem*> WORKITEMS;
-        typedef std::vector<std::pair<bool,WorkItem*> > RANKS;
+        typedef std::vector<std::pair<bool,BATCH> > RANKS;
         WORKITEMS witems;
         RANKS ranks;        
+        BATCH local; //batch computed by the master
+        std::vector<WorkItem*> pool; //workitems free for reuse
+        std::vector<double> msg; //request message buffer
+        std::vector<double> reply; //reply message buffer
+        std::vector<double> sent; //time the batch of every rank was sent
+        std::vector<int> queued; //workitems (or parts) of every job waiting to be sent
+        std::vector<int> open; //workitems of every job the observer has not been called for
+        std::deque<int> done; //jobs whose workitems have all been processed, in order
+        int turn; //job the last batch was taken from
+        int in_process; //ranks evaluating a batch
+        Stats counters;
+
+        //Partial - reduction of the parts of a workitem
+        struct Partial
+        {
+            Partial():pending(0),sum(0.0),failed(false),bounded(false) {}
+
+            int pending; //parts not returned yet
+            double sum; //sum of the finite residuals returned
+            bool failed; //any of the parts has failed
+            bool bounded; //any of the parts has been aborted
+        };
+        typedef std::map<WorkItem*,Partial> PARTIALS;
+        PARTIALS partials;
+        int nparts;
+        int nbatch;
+        bool affine;
 };
 
 
@@ -11,6 +11,7 @@
 #include "CISBootstrap.hpp"
 #include "virtexp.h"
 #include "distributor.h"
+#include "profile.h"
 
 
 using namespace std;
@@ -30,10 +31,22 @@ VariablesHolder var_template; //template for the variables, just holds names of
 
 int verbosity=0;	// verbosity initialised to 0
 
+#define TUNE_GENOMES 3	// genomes the solvers are tuned on
+#define TAG_SOLVERS 0x101	// message of the solvers picked by tuning
+
 void usage(const char *name)
 {
-    printf("Usage: %s <experiment definition xml> [-v [-v]]\n",name);
+    printf("Usage: %s <experiment definition xml> [-v [-v]] [-t threads] [-p] [-a] [-b batch] [-T telemetry] [-A archive [-W]]\n",name);
     printf("Where -v increases the verbosity of the output\n");
+    printf("      -t sets the number of threads evaluating experiments in each rank\n");
+    printf("      -p distributes every experiment of a genome as a separate work item\n");
+    printf("      -a makes every rank load only its share of experiments, implies -p\n");
+    printf("      -b sets the number of genomes sent to a rank at once\n");
+    printf("      -A appends every genome evaluated to the archive file\n");
+    printf("      -W seeds the population with the best genomes of the archive and skips evaluating archived genomes\n");
+    printf("      -T writes statistics of every generation to the file, as JSON Lines if it ends in .jsonl, CSV otherwise\n");
+    printf("Every GA element of the definition is run as a job, the jobs share the ranks; with several jobs\n");
+    printf("the archive of a job is the file suffixed with .<job> and no statistics are written\n");
 }
 
 //Open and read XML configuration file
@@ -66,6 +79,54 @@ char *OpenXmlFile(const char *name,long& nSize)
     return pBuffer;
 }
 
+//Read the file on rank 0 and broadcast its contents to the rest of ranks
+//so that the shared filesystem is accessed once rather than by every rank
+//nSize is assigned the size of file
+//return the contents of the file as a null-terminated char array on every rank, NULL if rank 0 failed to read it
+char *BroadcastFile(const char *name,long& nSize,int proc)
+{
+    char *pBuffer=NULL;
+    long size=-1;
+
+    if(!proc && (pBuffer=OpenXmlFile(name,nSize))!=NULL)
+        size=nSize;
+    MPI_Bcast(&size,1,MPI_LONG,0,MPI_COMM_WORLD);
+    if(size<0)
+        return NULL;
+
+    if(proc)
+    {
+        pBuffer=new char[size+1];
+        pBuffer[size]=0;
+        nSize=size;
+    }
+    MPI_Bcast(pBuffer,size,MPI_CHAR,0,MPI_COMM_WORLD);
+    return pBuffer;
+}
+
+//Broadcast the model documents of the virtual experiments from rank 0
+//every rank knows the experiments, so the broadcasts match up without any further index
+//models rank 0 cannot read as files (e.g. URLs) are left for each rank to load on its own
+void BroadcastModels(const AdvXMLParser::Element& root,int proc,SOURCES& sources)
+{
+    for(int i=0;;i++)
+    {
+        const AdvXMLParser::Element& elem=root("VirtualExperiments",0)("VirtualExperiment",i);
+        string strName=elem.GetAttribute("ModelFilePath").GetValue();
+        long nSize=0;
+
+        if(elem.IsNull() || !strName.size())
+            break;
+        if(sources.count(strName))
+            continue;
+
+        char *pBuffer=BroadcastFile(strName.c_str(),nSize,proc);
+        if(pBuffer)
+            sources[strName].assign(pBuffer,nSize);
+        delete [] pBuffer;
+    }
+}
+
 //Initialise GA engine
 	//return number of generations to run GA
 int SetAndInitEngine(GAEngine<COMP_FUNC >& ga,const AdvXMLParser::Element& elem)
@@ -76,6 +137,8 @@ int SetAndInitEngine(GAEngine<COMP_FUNC >& ga,const AdvXMLParser::Element& elem)
     double cross=atof(elem.GetAttribute("Crossover_proportion").GetValue().c_str());
     int generations=atoi(elem.GetAttribute("Generations").GetValue().c_str());
     int block_sample=atoi(elem.GetAttribute("Sampling").GetValue().c_str());
+    int early_abort=atoi(elem.GetAttribute("EarlyAbort").GetValue().c_str());
+    double screen_margin=atof(elem.GetAttribute("ScreenMargin").GetValue().c_str());
     
 
     //Set the parameters for the GA engine accordingly
@@ -89,6 +152,8 @@ int SetAndInitEngine(GAEngine<COMP_FUNC >& ga,const AdvXMLParser::Element& elem)
     ga.prob_mutate()=mutation;
     ga.part_cross()=(int)((double)initPopulation*cross);
     ga.part_mutate()=(int)((double)initPopulation*mutation);
+    ga.early_abort()=(early_abort!=0);
+    ga.screen_margin()=screen_margin;
 #ifdef SUPPORT_BLOCK_SAMPLING
     ga.block_sample()=(block_sample==0);
 #endif
@@ -130,6 +195,96 @@ void initialize_template_var(const AdvXMLParser::Element& elem)
     }
 }
 
+typedef std::vector<GAEngine<COMP_FUNC > *> ENGINES;
+
+/**
+ *	Tuning of the solvers of StepType="auto" experiments on a few genomes of the initial population
+ *
+ *	Every trial (experiment, candidate solver, genome) is a workitem of a job of its own,
+ *	evaluated by the ranks alongside the initial population. Once all of them are in,
+ *	the master picks the solvers and passes them on to the rest of ranks.
+ **/
+struct Tuning
+{
+    Tuning():job(-1),genomes(0) {}
+
+    int job;	// job of the trials, -1 if there are none
+    int genomes;	// genomes every candidate is tried on
+    std::vector<int> parts;	// experiments tuned
+    std::vector<double> residuals;	// of every trial, by experiment, candidate and genome
+    std::vector<double> seconds;	// the trials took on the ranks
+
+    void push(std::vector<VariablesHolder>& trial,int j);
+    void record(WorkItem *w,double answer);
+    void finish(const std::vector<std::string>& models);
+};
+
+static Tuning tuning;
+
+//Queue the trials of the candidates of every experiment tuned on the genomes as job j
+void Tuning::push(std::vector<VariablesHolder>& trial,int j)
+{
+    int n=VirtualExperiment::candidates();
+
+    genomes=trial.size();
+    residuals.assign(parts.size()*n*genomes,NAN);
+    seconds.assign(residuals.size(),0.0);
+    if(residuals.empty())
+        return;
+    job=j;
+    for(int p=0;p<parts.size();p++)
+    {
+        for(int c=0;c<n;c++)
+        {
+            int steptype;
+            double tolerance;
+
+            if(!VirtualExperiment::candidate(c,steptype,tolerance))
+                continue;
+            for(int k=0;k<genomes;k++)
+            {
+                WorkItem *w=Distributor::instance().get(trial[k].size());
+
+                w->key=(p*n+c)*genomes+k;
+                w->job=job;
+                w->part=parts[p];
+                w->solver=c;
+                std::copy(trial[k].values(),trial[k].values()+trial[k].size(),w->data.begin());
+                Distributor::instance().push(w);
+            }
+        }
+    }
+}
+
+void Tuning::record(WorkItem *w,double answer)
+{
+    residuals[w->key]=answer;
+    seconds[w->key]=w->elapsed;
+}
+
+//Pick the solvers once all the trials are in, printing the choice, and pass them on to every rank
+void Tuning::finish(const std::vector<std::string>& models)
+{
+    int n=VirtualExperiment::candidates()*genomes;
+    std::vector<double> solvers(2*models.size(),-1.0);
+
+    for(int p=0;p<parts.size();p++)
+    {
+        std::vector<double> r(residuals.begin()+p*n,residuals.begin()+(p+1)*n);
+        std::vector<double> s(seconds.begin()+p*n,seconds.begin()+(p+1)*n);
+        int steptype;
+        double tolerance;
+
+        VirtualExperiment::candidate(VirtualExperiment::choose(r,s,genomes),steptype,tolerance);
+        solvers[2*parts[p]]=steptype;
+        solvers[2*parts[p]+1]=tolerance;
+        //the choice can be pinned in the experiment definition
+        printf("Solver[%s]: StepType=\"%s\" Tolerance=\"%g\"\n",models[parts[p]].c_str(),VirtualExperiment::stepname(steptype),tolerance);
+    }
+    VEGroup::instance().solvers(solvers);
+    Distributor::instance().broadcast(TAG_SOLVERS,solvers);
+}
+
 //Observer callback
 bool observer(WorkItem *w,double answer,void *g)
 {
@@ -139,39 +294,188 @@ bool observer(WorkItem *w,double answer,void *g)
     return true;
 }
 
+//Observer callback of several jobs, the workitem goes to the engine of its job
+bool jobs_observer(WorkItem *w,double answer,void *e)
+{
+    ENGINES& engines=*(ENGINES *)e;
+
+    if(w->job==tuning.job)
+        tuning.record(w,answer);
+    else
+        engines[w->job]->process_workitem(w,answer);
+    return true;
+}
 
-// perform Evaluate from given vector of doubles
-double do_compute(std::vector<double>& val)
+/**
+ *	Run the engines as jobs sharing the ranks
+ *
+ *	Every engine is advanced to its next phase as soon as the work of its phase is done,
+ *	while the work of the other jobs is still being evaluated. A job queuing no work
+ *	(e.g. all its genomes are archived) is advanced again straight away.
+ *	The trials of tuning are a job too, the solvers are picked as soon as it is done.
+ **/
+void RunJobs(ENGINES& engines,std::vector<int>& generations,const std::vector<std::string>& models)
+{
+    std::deque<int> ready;	// jobs whose phase is done
+    int running=engines.size()+(tuning.job>=0);
+
+    for(int j=0;j<engines.size();j++)
+    {
+        engines[j]->job(j);
+        engines[j]->Start(generations[j]);
+        ready.push_back(j);
+    }
+    while(running)
+    {
+        while(!ready.empty())
+        {
+            int j=ready.front();
+
+            ready.pop_front();
+            if(!engines[j]->Advance())
+                running--;
+            else if(!Distributor::instance().outstanding(j))
+                ready.push_back(j);
+        }
+        if(!running)
+            break;
+
+        int j=Distributor::instance().process_any(jobs_observer,&engines);
+        if(j<0)
+            break;
+        if(j==tuning.job)
+        {
+            tuning.finish(models);
+            running--;
+        }
+        else
+            ready.push_back(j);
+    }
+}
+
+//Name of the archive of the job, suffixed with the job if there are several
+std::string JobArchive(const char *archive,int job,int jobs)
+{
+    char suffix[32];
+
+    if(jobs<2)
+        return archive;
+    sprintf(suffix,".%d",job);
+    return std::string(archive)+suffix;
+}
+
+
+// perform Evaluate from given allele values
+// against the part-th experiment only, or all of them if part is negative
+// evaluation is given up once the residual exceeds threshold, setting bounded
+// a candidate solver of tuning is tried on the part-th experiment if solver is not negative
+double compute(const double *val,int part,int solver,double threshold,bool& bounded)
 {
 	// fill-up the tmp's allele values with supplied data
-    var_template.fillup(val);
+    var_template.fillup(val,var_template.size());
+    bounded=false;
+    if(solver>=0)
+        return VEGroup::instance().trial(var_template,part,solver);
+    if(part>=0)
+        return VEGroup::instance().Evaluate(var_template,part,threshold,bounded);
 	// evaluate this chromosome's fit and return the representative residual
-    return VEGroup::instance().Evaluate(var_template);
+    return VEGroup::instance().Evaluate(var_template,threshold,bounded);
+}
+
+// compute every workitem of the request message and build the reply
+// a batch of whole genomes is evaluated together, the cache hits of the batch are reported with its first workitem
+// and its time is shared evenly by its workitems
+void do_compute(std::vector<double>& request,std::vector<double>& reply)
+{
+    PROFILE(PROF_COMPUTE);
+    static std::vector<VariablesHolder> vars;
+    static std::vector<double> thresholds,answers;
+    static std::vector<bool> bounded;
+    int block=REQ_HEADER+var_template.size();
+    int count=request.size()/block;
+    bool together=true;	// whole genomes of the same fidelity
+    int hits=VEGroup::instance().hits();
+
+    reply.resize(count*REP_SIZE);
+    for(int i=0;i<count;i++)
+        together=(together && request[i*block+REQ_PART]<0 && request[i*block+REQ_SOLVER]<0 &&
+                  request[i*block+REQ_FIDELITY]==request[REQ_FIDELITY]);
+
+    if(count>1 && together)
+    {
+        double started=monotonic_time();
+
+        VEGroup::instance().fidelity((int)request[REQ_FIDELITY]);
+        vars.resize(count,var_template);
+        thresholds.resize(count);
+        for(int i=0;i<count;i++)
+        {
+            vars[i].fillup(&request[i*block+REQ_HEADER],var_template.size());
+            thresholds[i]=request[i*block+REQ_THRESHOLD];
+        }
+        VEGroup::instance().Evaluate(vars,count,thresholds,answers,bounded);
+        double seconds=(monotonic_time()-started)/count;
+        for(int i=0;i<count;i++)
+        {
+            reply[i*REP_SIZE+REP_ANSWER]=answers[i];
+            reply[i*REP_SIZE+REP_BOUNDED]=(bounded[i]?1.0:0.0);
+            reply[i*REP_SIZE+REP_HITS]=0.0;
+            reply[i*REP_SIZE+REP_SECONDS]=seconds;
+        }
+        reply[REP_HITS]=VEGroup::instance().hits()-hits;
+        return;
+    }
+
+    for(int i=0;i<count;i++)
+    {
+        bool b;
+        double started=monotonic_time();
+
+        VEGroup::instance().fidelity((int)request[i*block+REQ_FIDELITY]);
+        reply[i*REP_SIZE+REP_ANSWER]=compute(&request[i*block+REQ_HEADER],(int)request[i*block+REQ_PART],(int)request[i*block+REQ_SOLVER],
+                                             request[i*block+REQ_THRESHOLD],b);
+        reply[i*REP_SIZE+REP_SECONDS]=monotonic_time()-started;
+        reply[i*REP_SIZE+REP_BOUNDED]=(b?1.0:0.0);
+        reply[i*REP_SIZE+REP_HITS]=VEGroup::instance().hits()-hits;
+        hits+=reply[i*REP_SIZE+REP_HITS];
+    }
 }
 
 //Slave process
 //Returns only when quit command is received from the master
 void run_slave(int proc)
 {
-    double req;
     MPI_Status stat;
-    std::vector<double> data;
+    std::vector<double> msg;
+    std::vector<double> reply;
 
-    var_template.collate(data); 
     while(1)
     {
+        int count;
+
         //check if data is received
-        MPI_Probe(MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,&stat);
+        {
+            PROFILE(PROF_MPI_WAIT);
+            MPI_Probe(MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,&stat);
+        }
         if(stat.MPI_TAG==TAG_QUIT)
         {
             //Quit signal received
             break;
         }
         //Receive compute request and process it
-        MPI_Recv(&data[0],data.size(),MPI_DOUBLE,MPI_ANY_SOURCE,MPI_ANY_TAG,MPI_COMM_WORLD,&stat);
-        req=do_compute(data);
+        MPI_Get_count(&stat,MPI_DOUBLE,&count);
+        msg.resize(count);
+        MPI_Recv((count?&msg[0]:NULL),msg.size(),MPI_DOUBLE,stat.MPI_SOURCE,stat.MPI_TAG,MPI_COMM_WORLD,&stat);
+        if(stat.MPI_TAG==TAG_SOLVERS)
+        {
+            //the solvers picked by tuning apply to the following requests
+            VEGroup::instance().solvers(msg);
+            continue;
+        }
+        do_compute(msg,reply);
         //returns the result of the computations
-        MPI_Send(&req,1,MPI_DOUBLE,0,0,MPI_COMM_WORLD);
+        MPI_Send(&reply[0],reply.size(),MPI_DOUBLE,0,0,MPI_COMM_WORLD);
     }
 }
 
@@ -179,10 +483,19 @@ int main(int argc,char *argv[])
 {
     char *pBuffer=NULL;
     long nSize=0;
-    GAEngine<COMP_FUNC > ga;	// initialise a GA engine
+    ENGINES engines;	// a GA engine per job
+    std::vector<int> generations;	// of every job
+    VariablesHolder layout;	// alleles of all the jobs, NaN for those a job leaves out
     int proc,nproc;
-    int generations=1;
+    int threads=1;
+    bool split=false;
+    bool affinity=false;
+    int batch=1;
     const char *filename=NULL;
+    const char *telemetry=NULL;
+    const char *archive=NULL;
+    bool warm=false;
+    std::vector<std::string> models;	// ModelFilePath of every experiment, naming them in the archive
 
     srand(time(NULL));	// seed the RNG
 
@@ -200,6 +513,27 @@ int main(int argc,char *argv[])
         if(!strcmp(argv[i],"-v"))
 			// if an arg string is "-v" increment verbosity
             verbosity++;
+        else if(!strcmp(argv[i],"-t") && i+1<argc)
+			// number of threads to evaluate the experiments with
+            threads=atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-p"))
+			// distribute (genome, experiment) pairs
+            split=true;
+        else if(!strcmp(argv[i],"-a"))
+			// experiments are dealt out to the ranks
+            split=affinity=true;
+        else if(!strcmp(argv[i],"-b") && i+1<argc)
+			// genomes to evaluate together
+            batch=atoi(argv[++i]);
+        else if(!strcmp(argv[i],"-T") && i+1<argc)
+			// per-generation statistics file
+            telemetry=argv[++i];
+        else if(!strcmp(argv[i],"-A") && i+1<argc)
+			// archive of the genomes evaluated
+            archive=argv[++i];
+        else if(!strcmp(argv[i],"-W"))
+			// warm start from the archive
+            warm=true;
         else
 			// other arg string becomes the filename
             filename=argv[i];
@@ -212,10 +546,11 @@ int main(int argc,char *argv[])
     bootstrap=CreateCellMLBootstrap();
     cis=CreateIntegrationService();
 
-	// Read input file and store contents in buffer
-    if((pBuffer=OpenXmlFile(filename,nSize)) == NULL)
+	// Read input file on rank 0 and pass its contents in buffer to every rank
+    if((pBuffer=BroadcastFile(filename,nSize,proc)) == NULL)
     {
-		fprintf(stderr,"Error opening input file %s\n",argv[1]);
+        if(!proc)
+		    fprintf(stderr,"Error opening input file %s\n",argv[1]);
 		return -1;
     }
 	// Read success: pBuffer is a C-string containing file and nSize is size of file
@@ -230,16 +565,64 @@ int main(int argc,char *argv[])
         auto_ptr<Document> pDoc(parser.Parse(pBuffer,nSize));	// can throw an exception
 		// Get the root of the XML structure
         const Element& root=pDoc->GetRoot();
+        SOURCES sources;	// model documents, read by rank 0 only
+
+		
+		// load the GA parameters from file and initialise the engine
+		//
+		// every GA element is a job, the template holds the alleles of all of them
+        for(int j=0;!root("GA",j).IsNull();j++)
+        {
+            if(!proc)
+            {
+				// assign number of generations and initialise the parameters for the GA engine
+                engines.push_back(new GAEngine<COMP_FUNC >);
+                generations.push_back(SetAndInitEngine(*engines.back(),root("GA",j)));
+            }
+            else
+            {
+				// initialise the template variable holder
+                initialize_template_var(root("GA",j));
+            }
+        }
+        layout=var_template;
+        for(int i=0;i<layout.size();i++)
+            layout.values()[i]=NAN;
+        for(int j=0;j<engines.size();j++)
+            engines[j]->layout(layout);
 
 		
-		// load all virtual experiments in the XML file
+		// load all virtual experiments in the XML file, once the alleles are known
         //
+        BroadcastModels(root,proc,sources);
+        for(int i=0;!root("VirtualExperiments",0)("VirtualExperiment",i).IsNull();i++)
+        {
+            models.push_back(root("VirtualExperiments",0)("VirtualExperiment",i).GetAttribute("ModelFilePath").GetValue());
+            if(VirtualExperiment::autosolver(root("VirtualExperiments",0)("VirtualExperiment",i)))
+                tuning.parts.push_back(i);
+        }
+        if(affinity)
+        {
+			// the experiments of the file are dealt out to the ranks once their number is known
+            int count=0;
+            while(!root("VirtualExperiments",0)("VirtualExperiment",count).IsNull())
+                count++;
+            Distributor::instance().parts(count);
+            Distributor::instance().affinity(true);
+        }
 		for(int i=0;;i++)
         {
             VariablesHolder params;	//??? unused
 
+			// leave the experiments of other ranks out, keeping their place in the group
+            if(!Distributor::instance().owns(proc,i) && !root("VirtualExperiments",0)("VirtualExperiment",i).IsNull())
+            {
+                VEGroup::instance().add(NULL);
+                continue;
+            }
+
 			// load the ith VE in file
-            VirtualExperiment *vx=VirtualExperiment::LoadExperiment(root("VirtualExperiments",0)("VirtualExperiment",i));
+            VirtualExperiment *vx=VirtualExperiment::LoadExperiment(root("VirtualExperiments",0)("VirtualExperiment",i),var_template,&sources);
 			// check if this VE is defined
 			if(!vx)
                break;
@@ -247,20 +630,10 @@ int main(int argc,char *argv[])
 			// add each VE into the group singleton
             VEGroup::instance().add(vx);
         }
-
-		
-		// load the GA parameters from file and initialise the engine
-		//
-        if(!proc)
-        {
-			// assign number of generations and initialise the parameters for the GA engine
-            generations=SetAndInitEngine(ga,root("GA",0));
-        }
-        else
-        {
-			// initialise the template variable holder
-            initialize_template_var(root("GA",0));
-        }
+        if(!split)
+            VEGroup::instance().share();	// integrate identical simulations once
+        VEGroup::instance().threads(threads);
+        VEGroup::instance().lanes(batch);
     }
     catch(ParsingException e)
     {
@@ -272,27 +645,93 @@ int main(int argc,char *argv[])
     //
     MPI_Barrier(MPI_COMM_WORLD);
 
+    //Initialise the populations on the master, the solvers of StepType="auto" experiments
+    //are tuned on a few genomes of the first job while the initial populations are evaluated
+    std::vector<VariablesHolder> trial;
+    if(!proc && !engines.empty())
+    {
+        trial.assign(TUNE_GENOMES,layout);
+        for(int j=0;j<engines.size();j++)
+        {
+			//Initialise the population in GA engine
+            engines[j]->Initialise();
+            if(archive && warm)
+            {
+                std::vector<Archive::Record> records;
+                std::string name=JobArchive(archive,j,engines.size());
+
+                if(Archive::read(name.c_str(),engines[j]->alleles(),models,records))
+                {
+                    int n=engines[j]->warm_start(records);
+                    if(verbosity)
+                        printf("Warm start of job %d: %d genomes archived, %d seeded\n",j,(int)records.size(),n);
+                }
+                else
+                    fprintf(stderr,"Archive %s does not match the alleles and experiments, starting cold\n",name.c_str());
+            }
+        }
+		//the solvers are tuned on the first job, the alleles it leaves out keep the values of the models
+        engines[0]->sample(TUNE_GENOMES,trial);
+    }
+
     //Only master tasks needs GA engine to be initialised and used   
     if(!proc)
     {
         //Master task
-        VariablesHolder v;
+        Telemetry stats;
+        std::vector<Archive *> evaluated;	// of every job
+
+        if(telemetry && engines.size()>1)
+            fprintf(stderr,"Statistics are not written with several jobs, the ranks are shared by them\n");
+        else if(telemetry && engines.size())
+        {
+            if(stats.open(telemetry))
+                engines[0]->telemetry(&stats);
+            else
+                fprintf(stderr,"Error creating telemetry file %s\n",telemetry);
+        }
+        for(int j=0;j<engines.size();j++)
+        {
+            evaluated.push_back(new Archive);
+            if(!archive)
+                continue;
+
+            std::string name=JobArchive(archive,j,engines.size());
+            if(evaluated[j]->open(name.c_str(),engines[j]->alleles(),models))
+                engines[j]->archive(evaluated[j]);
+            else
+                fprintf(stderr,"Error opening archive %s, it may hold other alleles or experiments\n",name.c_str());
+        }
+        if(split)
+            Distributor::instance().parts(VEGroup::instance().count());
+        Distributor::instance().batch(batch);
+        tuning.push(trial,engines.size());
 
-		//Initialise the population in GA engine
-        ga.Initialise();
 		//Run GA
-        ga.RunGenerations(generations);
+        RunJobs(engines,generations,models);
+        stats.close();
+        for(int j=0;j<engines.size();j++)
+        {
+            VariablesHolder v;
+
+            engines[j]->telemetry(NULL);
+            engines[j]->archive(NULL);
+            delete evaluated[j];	// closed once the records queued are written
         
-		double bf=ga.GetBest(v);	// v stores the best Genome's chromosome from the run; bf stores its fitness
+			double bf=engines[j]->GetBest(v);	// v stores the best Genome's chromosome from the run; bf stores its fitness
         
-		//Print out results for best fitness
-		printf("Best fitness: %lf\n",bf);
-        for(int i=0;;i++)
-        {
-            wstring name=v.name(i);
-            if(!name.size())
-                break;
-            printf("Best[%s]=%lf\n",convert(name).c_str(),v(name));
+			//Print out results for best fitness
+            if(engines.size()>1)
+                printf("Job %d\n",j);
+			printf("Best fitness: %lf\n",bf);
+            for(int i=0;;i++)
+            {
+                wstring name=v.name(i);
+                if(!name.size())
+                    break;
+                printf("Best[%s]=%lf\n",convert(name).c_str(),v(name));
+            }
+            delete engines[j];
         }
         Distributor::instance().finish();
     }
@@ -301,6 +740,26 @@ int main(int argc,char *argv[])
         run_slave(proc);
     }
 
+    //Sum up the timeouts of every experiment over the ranks
+    std::vector<int> timeouts,total;
+    VEGroup::instance().timeouts(timeouts);
+    total.resize(timeouts.size());
+    if(timeouts.size())
+        MPI_Reduce(&timeouts[0],&total[0],timeouts.size(),MPI_INT,MPI_SUM,0,MPI_COMM_WORLD);
+    if(!proc)
+    {
+        for(int i=0;i<total.size();i++)
+        {
+            VirtualExperiment *vx=VEGroup::instance().experiment(i);
+
+            if(total[i])
+                printf("Timeouts[%d](%s)=%d\n",i,(vx?vx->name().c_str():"-"),total[i]);
+        }
+    }
+
+    //Profile of the evaluation phases, built with SUPPORT_PROFILING only
+    Profile::report(proc);
+
     MPI_Barrier(MPI_COMM_WORLD);
 
     MPI_Finalize();
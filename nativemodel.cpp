@@ -0,0 +1,456 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <float.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <map>
+#include <algorithm>
+#include "nativemodel.h"
+#include "IfaceCCGS.hxx"
+#include "CCGSBootstrap.hpp"
+#include "utils.h"
+
+using namespace std;
+
+
+//Helper functions the generated code may refer to
+static const char *preamble=
+    "#include <math.h>\n"
+    "static double factorial(double x) { double r=1.0; for(;x>1.0;x-=1.0) r*=x; return r; }\n"
+    "static double arbitrary_log(double x,double base) { return log(x)/log(base); }\n"
+    "static double safe_quotient(double a,double b) { return (b==0.0)?0.0:floor(a/b); }\n"
+    "static double safe_remainder(double a,double b) { return (b==0.0)?0.0:fmod(a,b); }\n"
+    "static double sec(double x) { return 1.0/cos(x); }\n"
+    "static double csc(double x) { return 1.0/sin(x); }\n"
+    "static double cot(double x) { return 1.0/tan(x); }\n"
+    "static double sech(double x) { return 1.0/cosh(x); }\n"
+    "static double csch(double x) { return 1.0/sinh(x); }\n"
+    "static double coth(double x) { return 1.0/tanh(x); }\n"
+    "static double asec(double x) { return acos(1.0/x); }\n"
+    "static double acsc(double x) { return asin(1.0/x); }\n"
+    "static double acot(double x) { return atan(1.0/x); }\n"
+    "static double asech(double x) { return acosh(1.0/x); }\n"
+    "static double acsch(double x) { return asinh(1.0/x); }\n"
+    "static double acoth(double x) { return atanh(1.0/x); }\n";
+
+
+NativeModel::NativeModel():m_Handle(NULL),m_Setup(NULL),m_Rates(NULL),m_Variables(NULL),
+                           m_Lanes(0),m_Active(0),m_nConstants(0),m_nStates(0),m_nAlgebraic(0),
+                           m_Single(1),m_Deadline(0.0),m_TimedOut(false)
+{
+}
+
+NativeModel::~NativeModel()
+{
+    if(m_Handle)
+        dlclose(m_Handle);
+}
+
+//Name of the variable as used for alleles and parameters: component.variable
+static wstring full_name(iface::cellml_api::CellMLVariable *var)
+{
+    wstring comp=var->componentName();
+
+    if(comp.empty() || comp==L"all")
+        return var->name();
+    return comp+L"."+var->name();
+}
+
+//Turn the code of a single model into the code of a lane:
+//the arrays hold the variables of all the lanes, X[i] becomes X[i*LANES+l]
+static string lane_code(const string& code)
+{
+    static const char *arrays[]={"CONSTANTS[","STATES[","RATES[","ALGEBRAIC[",NULL};
+    string res;
+
+    for(size_t pos=0;pos<code.size();)
+    {
+        size_t len=0;
+
+        if(!pos || !(isalnum(code[pos-1]) || code[pos-1]=='_'))
+            for(int a=0;arrays[a];a++)
+                if(!code.compare(pos,strlen(arrays[a]),arrays[a]))
+                    len=strlen(arrays[a]);
+        size_t end=(len?code.find(']',pos+len):string::npos);
+        if(end==string::npos)
+        {
+            res+=code[pos++];
+            continue;
+        }
+        res+=code.substr(pos,end-pos)+"*LANES+l]";
+        pos=end+1;
+    }
+    return res;
+}
+
+/**
+ *	Generate the code of the model and compile it
+ *	
+ *	The initialisation code assigns every input from the PARAMS array
+ *	instead of its initial value, so the model is compiled once and
+ *	only the inputs change between the runs.
+ *	Inputs which are not constants or state variables of the model are ignored.
+ **/
+//Substitute the literals for the array elements they are the values of
+static string fold(const string& code,const map<string,string>& literals)
+{
+    string res;
+
+    for(size_t pos=0;pos<code.size();)
+    {
+        size_t end;
+        map<string,string>::const_iterator it=literals.end();
+
+        if(!code.compare(pos,10,"CONSTANTS[") && (!pos || !(isalnum(code[pos-1]) || code[pos-1]=='_')) &&
+           (end=code.find(']',pos))!=string::npos)
+            it=literals.find(code.substr(pos,end-pos+1));
+        if(it==literals.end())
+        {
+            res+=code[pos++];
+            continue;
+        }
+        res+=it->second;
+        pos=end+1;
+    }
+    return res;
+}
+
+bool NativeModel::Build(iface::cellml_api::Model *model,const std::vector<std::wstring>& inputs,
+                        const std::map<std::wstring,double>& fixed)
+{
+    ObjRef<iface::cellml_services::CodeGeneratorBootstrap> cgb;
+    ObjRef<iface::cellml_services::CodeGenerator> cg;
+    ObjRef<iface::cellml_services::CodeInformation> ci;
+    map<string,int> slots; //left hand side of the assignment of input -> index in PARAMS
+    map<string,string> literals; //left hand side of the assignment of fixed variable -> its value
+    map<string,string> constants; //literals of the constants, folded into the equations
+
+    m_Inputs=inputs;
+    try
+    {
+        cgb=CreateCodeGeneratorBootstrap();
+        cg=cgb->createCodeGenerator();
+        ci=cg->generateCode(model);
+        if(ci->constraintLevel()!=iface::cellml_services::CORRECTLY_CONSTRAINED)
+        {
+            fprintf(stderr,"Model is not correctly constrained: %s\n",convert(ci->errorMessage()).c_str());
+            return false;
+        }
+
+        //map the inputs to the array elements of the generated code
+        ObjRef<iface::cellml_services::ComputationTargetIterator> cti=ci->iterateTargets();
+        while(true)
+        {
+            ObjRef<iface::cellml_services::ComputationTarget> ct=cti->nextComputationTarget();
+            if(!ct)
+                break;
+            if(ct->degree())
+                continue;
+
+            const char *array;
+            if(ct->type()==iface::cellml_services::CONSTANT)
+                array="CONSTANTS";
+            else if(ct->type()==iface::cellml_services::STATE_VARIABLE)
+                array="STATES";
+            else
+                continue;
+
+            ObjRef<iface::cellml_api::CellMLVariable> var=ct->variable();
+            wstring name=full_name(var);
+            vector<wstring>::iterator it=find(m_Inputs.begin(),m_Inputs.end(),name);
+            map<wstring,double>::const_iterator fx=fixed.find(name);
+            char lhs[64];
+
+            sprintf(lhs,"%s[%u]",array,ct->assignedIndex());
+            if(it!=m_Inputs.end())
+                slots[lhs]=it-m_Inputs.begin();
+            else if(fx!=fixed.end() && fabs(fx->second)<=DBL_MAX)
+            {
+                char literal[40];
+                sprintf(literal,"(%.17e)",fx->second);	//always a floating point literal
+                literals[lhs]=literal;
+                if(ct->type()==iface::cellml_services::CONSTANT)
+                    constants[lhs]=literal;
+            }
+        }
+
+        m_nConstants=ci->constantIndexCount();
+        m_nStates=ci->rateIndexCount();
+        m_nAlgebraic=ci->algebraicIndexCount();
+    }
+    catch(iface::cellml_api::CellMLException e)
+    {
+        fprintf(stderr,"Error generating code for the model\n");
+        return false;
+    }
+
+    //initialisation code with the inputs substituted
+    string init=convert(ci->initConstsString());
+    string setup;
+    for(size_t pos=0;pos<init.size();)
+    {
+        size_t eol=init.find('\n',pos);
+        if(eol==string::npos)
+            eol=init.size();
+        string line=init.substr(pos,eol-pos);
+        size_t eq=line.find('=');
+        if(eq!=string::npos)
+        {
+            size_t b=line.find_first_not_of(" \t");
+            size_t e=line.find_last_not_of(" \t",eq-1);
+            string lhs=line.substr(b,e-b+1);
+            map<string,int>::iterator it=slots.find(lhs);
+            map<string,string>::iterator lit=literals.find(lhs);
+            if(it!=slots.end())
+            {
+                char assign[48];
+                sprintf(assign," = PARAMS[l*%d+%d];",(int)m_Inputs.size(),it->second);
+                line=line.substr(0,eq)+assign;
+            }
+            else if(lit!=literals.end())
+                line=line.substr(0,eq)+" = "+lit->second+";";
+            else
+                line=line.substr(0,eq+1)+fold(line.substr(eq+1),constants);
+        }
+        setup+=line+"\n";
+        pos=eol+1;
+    }
+
+    string source=preamble;
+    source+="void setup(int LANES,double *CONSTANTS,double *RATES,double *STATES,const double *PARAMS)\n{\n";
+    source+="double VOI=0.0;\nint l;\nfor(l=0;l<LANES;l++)\n{\n"+lane_code(setup)+"}\n}\n";
+    source+="void rates(int LANES,double VOI,double *CONSTANTS,double *RATES,double *STATES,double *ALGEBRAIC)\n{\n";
+    source+="int l;\n#pragma omp simd\nfor(l=0;l<LANES;l++)\n{\n"+lane_code(fold(convert(ci->ratesString()),constants))+"}\n}\n";
+    source+="void variables(int LANES,double VOI,double *CONSTANTS,double *RATES,double *STATES,double *ALGEBRAIC)\n{\n";
+    source+="int l;\n#pragma omp simd\nfor(l=0;l<LANES;l++)\n{\n"+lane_code(fold(convert(ci->variablesString()),constants))+"}\n}\n";
+
+    if(!Compile(source))
+        return false;
+
+    m_Record.resize(recsize());
+    lanes(1);
+    return true;
+}
+
+//Allocate the arrays for n lanes
+void NativeModel::lanes(int n)
+{
+    if(n<=m_Lanes)
+        return;
+    m_Lanes=n;
+    m_Constants.resize(n*m_nConstants+1); //+1 keeps &x[0] valid for empty arrays
+    m_States.resize(n*m_nStates+1);
+    m_RatesBuf.resize(n*m_nStates+1);
+    m_Algebraic.resize(n*m_nAlgebraic+1);
+    m_Params.resize(n*m_Inputs.size()+1);
+    m_Solver.resize(m_nStates,n);
+}
+
+//Compile the source into a shared object with the system compiler and load it
+//$CC is used as the compiler and $NATIVE_CFLAGS as its options if set
+//Shared objects are kept in the cache directory $NATIVE_CACHE ($TMPDIR/vxnative-<uid> by default,
+//empty not to cache) named by the hash of the source and the compiler command, so that
+//later runs and the other ranks of the node load them instead of compiling again
+//The cache is trusted only if it is a directory of the user no one else may write to,
+//otherwise the code is compiled afresh into a private directory and nothing is loaded from the cache
+//The lock serialising the ranks of a node is removed once the shared object is in the cache,
+//ranks still waiting on it find the shared object and arrivals after that do not need it
+bool NativeModel::Compile(const std::string& source)
+{
+    const char *tmp=getenv("TMPDIR");
+    const char *cc=getenv("CC");
+    const char *cflags=getenv("NATIVE_CFLAGS");
+    const char *cache=getenv("NATIVE_CACHE");
+    string compiler=string(cc?cc:"cc")+" "+(cflags?cflags:"-O3 -march=native -fopenmp-simd");
+    string base;
+    string cached;
+    int lock=-1;
+    bool res=false;
+
+    if(cache)
+        base=cache;
+    else
+    {
+        char user[32];
+        sprintf(user,"/vxnative-%u",(unsigned)getuid());
+        base=string(tmp?tmp:"/tmp")+user;
+    }
+    if(base.size() && (mkdir(base.c_str(),0700)==0 || errno==EEXIST) && owned(base,true))
+    {
+        char key[32];
+        sprintf(key,"/%016llx",hash(compiler+"\n"+source));
+        cached=base+key+".so";
+
+        //the first rank to get here compiles, the rest wait for it and load the result
+        string lockname=cached+".lock";
+        lock=open(lockname.c_str(),O_CREAT|O_RDWR|O_NOFOLLOW,0600);
+        if(lock>=0)
+            flock(lock,LOCK_EX);
+        if(!access(cached.c_str(),R_OK) && owned(cached,false) && Load(cached))
+        {
+            if(lock>=0)
+            {
+                unlink(lockname.c_str());
+                close(lock);	// releases the lock
+            }
+            return true;
+        }
+    }
+    else
+    {
+        if(base.size())
+            fprintf(stderr,"Model code cache %s is not private to the user, compiling without it\n",base.c_str());
+        base=(tmp?tmp:"/tmp");
+    }
+
+    string dir=base+"/buildXXXXXX";
+    if(!mkdtemp(&dir[0]))	// created with mode 0700
+    {
+        fprintf(stderr,"Unable to create directory for the model code\n");
+        if(lock>=0)
+            close(lock);
+        return false;
+    }
+    string src=dir+"/model.c";
+    string so=dir+"/model.so";
+
+    FILE *f=fopen(src.c_str(),"w");
+    if(f)
+    {
+        fwrite(source.c_str(),source.size(),1,f);
+        fclose(f);
+
+        string cmd=compiler+" -shared -fPIC -o "+so+" "+src+" -lm";
+        if(!system(cmd.c_str()))
+        {
+            //publish the shared object in the cache, renaming replaces it atomically
+            if(cached.size() && !rename(so.c_str(),cached.c_str()))
+                so=cached;
+            res=Load(so);
+        }
+        else
+            fprintf(stderr,"Unable to compile the model code: %s\n",cmd.c_str());
+    }
+    if(so!=cached)
+        unlink(so.c_str());	//the shared object stays mapped once the file is removed
+    unlink(src.c_str());
+    rmdir(dir.c_str());
+    if(lock>=0)
+    {
+        if(so==cached)
+            unlink((cached+".lock").c_str());
+        close(lock);
+    }
+    return res;
+}
+
+//Whether the path is a directory (or a regular file) of the user which neither the group nor others may write to
+//symbolic links are not followed, so they are never trusted
+bool NativeModel::owned(const std::string& path,bool dir)
+{
+    struct stat st;
+
+    if(lstat(path.c_str(),&st))
+        return false;
+    if(dir?!S_ISDIR(st.st_mode):!S_ISREG(st.st_mode))
+        return false;
+    return (st.st_uid==getuid() && !(st.st_mode&(S_IWGRP|S_IWOTH)));
+}
+
+//Load the compiled model code from the shared object
+bool NativeModel::Load(const std::string& so)
+{
+    m_Handle=dlopen(so.c_str(),RTLD_NOW|RTLD_LOCAL);
+    if(!m_Handle)
+    {
+        fprintf(stderr,"Unable to load the model code: %s\n",dlerror());
+        return false;
+    }
+    m_Setup=(SETUP)dlsym(m_Handle,"setup");
+    m_Rates=(COMPUTE)dlsym(m_Handle,"rates");
+    m_Variables=(COMPUTE)dlsym(m_Handle,"variables");
+    return (m_Setup && m_Rates && m_Variables);
+}
+
+//FNV-1a hash of the text
+unsigned long long NativeModel::hash(const std::string& text)
+{
+    unsigned long long h=14695981039346656037ULL;
+
+    for(size_t i=0;i<text.size();i++)
+    {
+        h^=(unsigned char)text[i];
+        h*=1099511628211ULL;
+    }
+    return h;
+}
+
+void NativeModel::rates(double t,const double *y,double *dy)
+{
+    m_Rates(m_Active,t,&m_Constants[0],dy,(double *)y,&m_Algebraic[0]);
+}
+
+bool NativeModel::interrupted()
+{
+    if(m_Deadline>0.0 && monotonic_time()>m_Deadline)
+        m_TimedOut=true;
+    return m_TimedOut;
+}
+
+bool NativeModel::Run(const std::vector<double>& times,ResultsMonitor& m,double maxtime)
+{
+    m_Single[0]=&m;
+    return Run(times,m_Single,maxtime);
+}
+
+bool NativeModel::Run(const std::vector<double>& times,std::vector<ResultsMonitor *>& m,double maxtime)
+{
+    double t=0.0;
+    int n=m_nStates;
+    int L=m_Active=m.size();
+    int running=L;
+
+    if(L>m_Lanes)
+        return false;
+    m_Deadline=(maxtime>0.0?monotonic_time()+maxtime:0.0);
+    m_TimedOut=false;
+    m_Setup(L,&m_Constants[0],&m_RatesBuf[0],&m_States[0],&m_Params[0]);
+    m_Solver.lanes(L);
+    m_Solver.reset();
+
+    for(int i=0;i<times.size() && running;i++)
+    {
+        if(times[i]>t && !m_Solver.advance(*this,t,times[i],&m_States[0]))
+            return false;
+
+        //build the records the same way the integration service reports them
+        m_Rates(L,t,&m_Constants[0],&m_RatesBuf[0],&m_States[0],&m_Algebraic[0]);
+        m_Variables(L,t,&m_Constants[0],&m_RatesBuf[0],&m_States[0],&m_Algebraic[0]);
+        running=0;
+        for(int l=0;l<L;l++)
+        {
+            if(!m_Solver.active(l))
+                continue;
+            m_Record[0]=t;
+            for(int k=0;k<n;k++)
+            {
+                m_Record[1+k]=m_States[k*L+l];
+                m_Record[1+n+k]=m_RatesBuf[k*L+l];
+            }
+            for(int k=0;k<m_nAlgebraic;k++)
+                m_Record[1+2*n+k]=m_Algebraic[k*L+l];
+            if(m[l]->examine(&m_Record[0],m_Record.size()))
+                running++;
+            else
+                m_Solver.mask(l);
+        }
+    }
+    return true;
+}
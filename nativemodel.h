@@ -0,0 +1,94 @@
+//NativeModel class generates C code for the equations of a CellML model,
+//compiles it with the system compiler into a shared object
+//and integrates it in-process with StiffSolver
+//The generated code evaluates a batch of lanes (copies of the model with
+//different inputs) in a loop the compiler can vectorise, so several
+//parameter sets are integrated in lockstep
+#ifndef NATIVE_MODEL_H
+#define NATIVE_MODEL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <time.h>
+#include "cellml-api-cxx-support.hpp"
+#include "IfaceCellML_APISPEC.hxx"
+#include "cellml_observer.h"
+#include "odesolver.h"
+
+
+class NativeModel:public OdeSystem
+{
+    public:
+        NativeModel();
+        ~NativeModel();
+
+        //Generate and compile the model, inputs are the names of the variables set before every run
+        //fixed variables are compiled in as constants
+        bool Build(iface::cellml_api::Model *model,const std::vector<std::wstring>& inputs,
+                   const std::map<std::wstring,double>& fixed);
+
+        void lanes(int n); //allocate for up to n lanes
+        int lanes() const { return m_Lanes; }
+
+        int inputs() const { return m_Inputs.size(); }
+        const std::wstring& input(int i) const { return m_Inputs[i]; }
+        void set(int i,double val) { m_Params[i]=val; }
+        void set(int lane,int i,double val) { m_Params[lane*m_Inputs.size()+i]=val; }
+
+        void tolerances(double atol,double rtol,double maxstep) { m_Solver.tolerances(atol,rtol,maxstep); }
+
+        //Integrate from 0.0 passing the record at every time of (sorted) times to the monitor
+        //the integration stops early if the monitor returns false
+        //returns false if the integration failed or took longer than maxtime seconds, 0 for no limit
+        bool Run(const std::vector<double>& times,ResultsMonitor& m,double maxtime);
+
+        //Integrate a lane per monitor in lockstep, a lane stops being integrated
+        //once its monitor returns false or it fails on its own
+        //returns false if all the lanes failed or it took longer than maxtime seconds
+        bool Run(const std::vector<double>& times,std::vector<ResultsMonitor *>& m,double maxtime);
+        bool failed(int lane) const { return m_Solver.failed(lane); }
+        bool timedout() const { return m_TimedOut; } //the last run was interrupted by maxtime
+
+        //size of the records passed to the monitor: VOI, states, rates, algebraic
+        int recsize() const { return 1+2*m_nStates+m_nAlgebraic; }
+
+        //OdeSystem
+        void rates(double t,const double *y,double *dy);
+        bool interrupted();
+
+    private:
+        typedef void (*SETUP)(int LANES,double *CONSTANTS,double *RATES,double *STATES,const double *PARAMS);
+        typedef void (*COMPUTE)(int LANES,double VOI,double *CONSTANTS,double *RATES,double *STATES,double *ALGEBRAIC);
+
+        bool Compile(const std::string& source);
+        bool Load(const std::string& so);
+        static unsigned long long hash(const std::string& text);
+        static bool owned(const std::string& path,bool dir); //owned by the user and writable by nobody else
+
+        std::vector<std::wstring> m_Inputs;
+        void *m_Handle; //shared object handle
+        SETUP m_Setup;
+        COMPUTE m_Rates;
+        COMPUTE m_Variables;
+
+        int m_Lanes; //lanes allocated
+        int m_Active; //lanes of the current run
+        int m_nConstants;
+        int m_nStates;
+        int m_nAlgebraic;
+
+        std::vector<double> m_Constants;
+        std::vector<double> m_States;
+        std::vector<double> m_RatesBuf;
+        std::vector<double> m_Algebraic;
+        std::vector<double> m_Params;
+        std::vector<double> m_Record;
+        std::vector<ResultsMonitor *> m_Single; //monitor of a single lane run
+        StiffSolver m_Solver;
+
+        double m_Deadline; //monotonic time the run is interrupted at, 0 for none
+        bool m_TimedOut;
+};
+
+#endif
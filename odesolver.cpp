@@ -0,0 +1,288 @@
+#include <math.h>
+#include "odesolver.h"
+
+
+#define GAMMA (1.0+1.0/sqrt(2.0))
+#define MAX_STEPS 1000000
+#define SAFETY 0.9
+#define MIN_FACTOR 0.2
+#define MAX_FACTOR 5.0
+
+
+StiffSolver::StiffSolver():m_N(0),m_L(1),m_Atol(1e-6),m_Rtol(1e-6),m_MaxStep(1.0),m_Step(0.0)
+{
+}
+
+StiffSolver::~StiffSolver()
+{
+}
+
+void StiffSolver::resize(int n,int lanes)
+{
+    m_N=n;
+    m_L=lanes;
+    m_J.resize(lanes*n*n);
+    m_W.resize(lanes*n*n);
+    m_Pivot.resize(lanes*n);
+    m_F0.resize(lanes*n);
+    m_K1.resize(lanes*n);
+    m_K2.resize(lanes*n);
+    m_Tmp.resize(lanes*n);
+    m_Dy.resize(lanes*n);
+    m_Err.resize(lanes);
+    m_State.resize(lanes);
+}
+
+void StiffSolver::lanes(int l)
+{
+    m_L=(l<m_State.size()?l:m_State.size());
+}
+
+void StiffSolver::tolerances(double atol,double rtol,double maxstep)
+{
+    m_Atol=atol;
+    m_Rtol=rtol;
+    m_MaxStep=maxstep;
+}
+
+void StiffSolver::reset()
+{
+    m_Step=0.0;
+    for(int l=0;l<m_L;l++)
+        m_State[l]=LANE_ACTIVE;
+}
+
+int StiffSolver::remaining() const
+{
+    int r=0;
+
+    for(int l=0;l<m_L;l++)
+        if(m_State[l]==LANE_ACTIVE)
+            r++;
+    return r;
+}
+
+//Finite difference approximation of the Jacobians at (t,y)
+//m_F0 must hold f(t,y); the lanes are independent, so column j
+//of every lane's Jacobian is obtained from a single evaluation
+void StiffSolver::jacobian(OdeSystem& f,double t,double *y)
+{
+    double *J=&m_J[0];
+
+    for(int j=0;j<m_N;j++)
+    {
+        for(int l=0;l<m_L;l++)
+        {
+            double yj=y[j*m_L+l];
+
+            m_Err[l]=sqrt(2.2e-16)*(fabs(yj)>1e-5?fabs(yj):1e-5); //perturbation of the lane
+            y[j*m_L+l]=yj+m_Err[l];
+        }
+        f.rates(t,y,&m_Dy[0]);
+        for(int l=0;l<m_L;l++)
+        {
+            y[j*m_L+l]-=m_Err[l];
+            for(int i=0;i<m_N;i++)
+                J[(l*m_N+i)*m_N+j]=(m_Dy[i*m_L+l]-m_F0[i*m_L+l])/m_Err[l];
+        }
+    }
+}
+
+//LU decomposition with partial pivoting of W=I-gamma*h*J for every active lane
+//returns the first lane W of which is singular, -1 if there is none
+int StiffSolver::decompose(double h)
+{
+    for(int l=0;l<m_L;l++)
+    {
+        double *W=&m_W[l*m_N*m_N];
+        const double *J=&m_J[l*m_N*m_N];
+        int *piv=&m_Pivot[l*m_N];
+
+        if(m_State[l]!=LANE_ACTIVE)
+            continue;
+        for(int i=0;i<m_N*m_N;i++)
+            W[i]=-GAMMA*h*J[i];
+        for(int i=0;i<m_N;i++)
+            W[i*m_N+i]+=1.0;
+
+        for(int k=0;k<m_N;k++)
+        {
+            int p=k;
+
+            for(int i=k+1;i<m_N;i++)
+                if(fabs(W[i*m_N+k])>fabs(W[p*m_N+k]))
+                    p=i;
+            piv[k]=p;
+            if(W[p*m_N+k]==0.0 || W[p*m_N+k]!=W[p*m_N+k])
+                return l;
+            if(p!=k)
+                for(int j=0;j<m_N;j++)
+                {
+                    double s=W[k*m_N+j];
+                    W[k*m_N+j]=W[p*m_N+j];
+                    W[p*m_N+j]=s;
+                }
+            for(int i=k+1;i<m_N;i++)
+            {
+                double c=(W[i*m_N+k]/=W[k*m_N+k]);
+
+                for(int j=k+1;j<m_N;j++)
+                    W[i*m_N+j]-=c*W[k*m_N+j];
+            }
+        }
+    }
+    return -1;
+}
+
+//Solve W x=b for every active lane using the decompositions, b is replaced with x
+void StiffSolver::solve(double *b)
+{
+    for(int l=0;l<m_L;l++)
+    {
+        const double *W=&m_W[l*m_N*m_N];
+        const int *piv=&m_Pivot[l*m_N];
+
+        if(m_State[l]!=LANE_ACTIVE)
+            continue;
+        for(int k=0;k<m_N;k++)
+        {
+            int p=piv[k];
+
+            if(p!=k)
+            {
+                double s=b[k*m_L+l];
+                b[k*m_L+l]=b[p*m_L+l];
+                b[p*m_L+l]=s;
+            }
+            for(int i=k+1;i<m_N;i++)
+                b[i*m_L+l]-=W[i*m_N+k]*b[k*m_L+l];
+        }
+        for(int i=m_N-1;i>=0;i--)
+        {
+            for(int j=i+1;j<m_N;j++)
+                b[i*m_L+l]-=W[i*m_N+j]*b[j*m_L+l];
+            b[i*m_L+l]/=W[i*m_N+i];
+        }
+    }
+}
+
+/**
+ *	Integrate y from t to tend, on success t is set to tend
+ *	
+ *	ROS2 step:	W k1 = f(t,y)
+ *				W k2 = f(t+h,y+h k1) - 2 k1
+ *				y'   = y + h (3/2 k1 + 1/2 k2)
+ *	the difference to the embedded first order solution y+h k1 estimates the error
+ *	
+ *	The step is accepted when it is accurate for every active lane.
+ *	When the step size underflows, the lanes which cannot meet the tolerance
+ *	fail and the rest carry on. Returns false when there are no lanes left.
+ **/
+bool StiffSolver::advance(OdeSystem& f,double& t,double tend,double *y)
+{
+    double h=m_Step;
+    double h_ok=0.0; //step size the last step has been accepted with
+    bool fresh=false; //Jacobian is valid for (t,y)
+    int n=m_N*m_L;
+
+    if(!m_N || !remaining())
+    {
+        t=tend;
+        return (remaining()>0);
+    }
+    if(h<=0.0)
+        h=(tend-t)*1e-3;
+    if(h>m_MaxStep)
+        h=m_MaxStep;
+
+    for(int steps=0;t<tend;steps++)
+    {
+        bool last=false;
+
+        if(steps>MAX_STEPS || f.interrupted())
+            return false;
+        if(h>=tend-t)
+        {
+            h=tend-t;
+            last=true;
+        }
+        if(!fresh)
+        {
+            f.rates(t,y,&m_F0[0]);
+            jacobian(f,t,y);
+            fresh=true;
+        }
+
+        int singular=decompose(h);
+        double err=0.0; //largest error of the active lanes
+        if(singular<0)
+        {
+            for(int i=0;i<n;i++)
+                m_K1[i]=m_F0[i];
+            solve(&m_K1[0]);
+            for(int i=0;i<n;i++)
+                m_Tmp[i]=y[i]+h*m_K1[i];
+            f.rates(t+h,&m_Tmp[0],&m_K2[0]);
+            for(int i=0;i<n;i++)
+                m_K2[i]-=2.0*m_K1[i];
+            solve(&m_K2[0]);
+
+            //weighted RMS norm of the error estimate of every lane
+            for(int l=0;l<m_L;l++)
+                m_Err[l]=0.0;
+            for(int i=0;i<n;i++)
+            {
+                double yn=y[i]+h*(1.5*m_K1[i]+0.5*m_K2[i]);
+                double sc=m_Atol+m_Rtol*(fabs(y[i])>fabs(yn)?fabs(y[i]):fabs(yn));
+                double e=0.5*h*(m_K1[i]+m_K2[i])/sc;
+
+                m_Tmp[i]=yn;
+                m_Err[i%m_L]+=e*e;
+            }
+            for(int l=0;l<m_L;l++)
+            {
+                m_Err[l]=sqrt(m_Err[l]/m_N);
+                if(m_Err[l]!=m_Err[l]) //NaN
+                    m_Err[l]=1e10;
+                if(m_State[l]==LANE_ACTIVE && m_Err[l]>err)
+                    err=m_Err[l];
+            }
+        }
+        else
+            err=1e10;
+
+        double factor=(err>0.0?SAFETY/sqrt(err):MAX_FACTOR);
+        if(factor<MIN_FACTOR)
+            factor=MIN_FACTOR;
+        if(factor>MAX_FACTOR)
+            factor=MAX_FACTOR;
+
+        if(err<=1.0)
+        {
+            //accept the step
+            for(int i=0;i<n;i++)
+                y[i]=m_Tmp[i];
+            t=(last?tend:t+h);
+            fresh=false;
+            h_ok=h;
+            if(!last)
+                m_Step=h;
+        }
+        h*=factor;
+        if(h>m_MaxStep)
+            h=m_MaxStep;
+        if(h<1e-14*(fabs(t)>1.0?fabs(t):1.0))
+        {
+            //step size underflow, give up the lanes which cannot make it
+            for(int l=0;l<m_L;l++)
+                if(m_State[l]==LANE_ACTIVE && (singular<0?m_Err[l]>1.0:l==singular))
+                    m_State[l]=LANE_FAILED;
+            if(!remaining())
+                return false;
+            h=(h_ok>0.0?h_ok:(tend-t)*1e-3);
+        }
+    }
+    if(m_Step<=0.0)
+        m_Step=h;
+    return true;
+}
@@ -0,0 +1,65 @@
+//StiffSolver class integrates ODE systems in-process
+//over plain arrays of doubles
+#ifndef ODESOLVER_H
+#define ODESOLVER_H
+
+#include <vector>
+
+
+//Right hand side of an ODE system dy/dt=f(t,y)
+//for a batch of lanes (independent copies of the system) the arrays
+//hold the variables of all the lanes, lane index running fastest: y[i*lanes+l]
+class OdeSystem
+{
+    public:
+        virtual ~OdeSystem() {}
+        virtual void rates(double t,const double *y,double *dy)=0; //compute dy at (t,y)
+        virtual bool interrupted() { return false; } //checked every step, true aborts integration
+};
+
+//Rosenbrock ROS2 integrator with adaptive step size control
+//L-stable and of order 2 with any Jacobian approximation,
+//so a finite difference Jacobian is sufficient for stiff systems.
+//Lanes are integrated in lockstep sharing the step size, every lane
+//has its own Jacobian and error estimate. Lanes which have failed
+//or were masked by the caller do not take part in step size control.
+//All the workspace is allocated by resize(), advance() does not allocate.
+class StiffSolver
+{
+    public:
+        StiffSolver();
+        ~StiffSolver();
+
+        void resize(int n,int lanes=1); //allocate workspace for a system of n equations
+        void lanes(int l); //number of lanes to integrate, up to the lanes allocated
+        void tolerances(double atol,double rtol,double maxstep);
+        void reset(); //forget step size of previous integration, activate all the lanes
+        bool advance(OdeSystem& f,double& t,double tend,double *y); //integrate y from t to tend, false if no lane is left
+
+        void mask(int l) { if(m_State[l]==LANE_ACTIVE) m_State[l]=LANE_MASKED; } //exclude lane from integration
+        bool active(int l) const { return m_State[l]==LANE_ACTIVE; }
+        bool failed(int l) const { return m_State[l]==LANE_FAILED; }
+
+    private:
+        enum { LANE_ACTIVE, LANE_MASKED, LANE_FAILED };
+
+        void jacobian(OdeSystem& f,double t,double *y);
+        int decompose(double h); //LU decomposition of W=I-gamma*h*J, returns singular lane or -1
+        void solve(double *b); //solve W x=b in place
+        int remaining() const; //number of active lanes
+
+        int m_N;
+        int m_L; //lanes in use
+        double m_Atol;
+        double m_Rtol;
+        double m_MaxStep;
+        double m_Step; //step size to start next step with, 0.0 if unknown
+        std::vector<double> m_J; //Jacobians of the lanes, row-major
+        std::vector<double> m_W; //LU decompositions of W
+        std::vector<int> m_Pivot;
+        std::vector<double> m_F0,m_K1,m_K2,m_Tmp,m_Dy;
+        std::vector<double> m_Err; //error estimate of the lanes
+        std::vector<char> m_State; //LANE_xxx
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "profile.h"
+
+#ifdef SUPPORT_PROFILING
+#include <mpi.h>
+#include <stdio.h>
+#include <vector>
+
+static const char *phase_names[PROF_PHASES]=
+{
+    "do_compute",
+    "SetVariables",
+    "compileModelODE",
+    "createODEIntegrationRun",
+    "solver wait",
+    "results",
+    "score",
+    "native run",
+    "MPI wait"
+};
+
+//calls and nanoseconds of every phase, added to atomically by the evaluating threads
+static volatile long long phase_calls[PROF_PHASES];
+static volatile long long phase_nsec[PROF_PHASES];
+
+
+void Profile::add(int phase,double seconds)
+{
+    __sync_fetch_and_add(&phase_calls[phase],1LL);
+    __sync_fetch_and_add(&phase_nsec[phase],(long long)(seconds*1e9));
+}
+
+//Every rank contributes calls and seconds of every phase, rank 0 prints a row per phase and rank
+//followed by the totals over the ranks
+void Profile::report(int proc)
+{
+    int nproc;
+    double local[2*PROF_PHASES];
+    std::vector<double> all;
+
+    MPI_Comm_size(MPI_COMM_WORLD,&nproc);
+    for(int i=0;i<PROF_PHASES;i++)
+    {
+        local[2*i]=(double)phase_calls[i];
+        local[2*i+1]=1e-9*(double)phase_nsec[i];
+    }
+    if(!proc)
+        all.resize(2*PROF_PHASES*nproc);
+    MPI_Gather(local,2*PROF_PHASES,MPI_DOUBLE,(proc?NULL:&all[0]),2*PROF_PHASES,MPI_DOUBLE,0,MPI_COMM_WORLD);
+    if(proc)
+        return;
+
+    printf("%-24s %5s %12s %12s %12s\n","Phase","Rank","Calls","Seconds","Mean(ms)");
+    for(int i=0;i<PROF_PHASES;i++)
+    {
+        double calls=0.0,sec=0.0;
+
+        for(int r=0;r<nproc;r++)
+        {
+            double c=all[r*2*PROF_PHASES+2*i],s=all[r*2*PROF_PHASES+2*i+1];
+
+            calls+=c;
+            sec+=s;
+            if(c)
+                printf("%-24s %5d %12.0f %12.3f %12.3f\n",phase_names[i],r,c,s,1e3*s/c);
+        }
+        if(calls)
+            printf("%-24s %5s %12.0f %12.3f %12.3f\n",phase_names[i],"all",calls,sec,1e3*sec/calls);
+    }
+}
+#endif
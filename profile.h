@@ -0,0 +1,54 @@
+//Profile - time spent in the phases of evaluation on every rank
+//the timers are only compiled in if SUPPORT_PROFILING is defined,
+//otherwise PROFILE() expands to nothing and report() prints nothing
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "utils.h"
+
+//#define SUPPORT_PROFILING
+
+//Phases timed
+#define PROF_COMPUTE 0 //do_compute as a whole
+#define PROF_SET_VARIABLES 1
+#define PROF_COMPILE 2 //compileModelODE
+#define PROF_CREATE_RUN 3 //createODEIntegrationRun
+#define PROF_SOLVER 4 //waiting for the integration service to finish
+#define PROF_RESULTS 5 //extracting and scoring the results
+#define PROF_SCORE 6 //scoring a record against the assessment points
+#define PROF_NATIVE 7 //integrating a compiled model
+#define PROF_MPI_WAIT 8 //workers waiting for requests
+#define PROF_PHASES 9
+
+class Profile
+{
+    public:
+#ifdef SUPPORT_PROFILING
+        static void add(int phase,double seconds); //count a call of the phase, safe from any thread
+        static void report(int proc); //collective: gather the profiles of all the ranks to rank 0 and print them
+#else
+        static void report(int /*proc*/) {}
+#endif
+};
+
+#ifdef SUPPORT_PROFILING
+//ScopedTimer - adds the time from construction to destruction to the phase
+class ScopedTimer
+{
+    public:
+        ScopedTimer(int phase):m_Phase(phase),m_Started(monotonic_time()) {}
+        ~ScopedTimer() { Profile::add(m_Phase,monotonic_time()-m_Started); }
+
+    private:
+        int m_Phase;
+        double m_Started;
+};
+
+#define PROFILE_CONCAT(a,b) a##b
+#define PROFILE_NAME(line) PROFILE_CONCAT(profile_timer_,line)
+#define PROFILE(phase) ScopedTimer PROFILE_NAME(__LINE__)(phase)
+#else
+#define PROFILE(phase)
+#endif
+
+#endif
@@ -0,0 +1,127 @@
+#include <string.h>
+#include <math.h>
+#include "telemetry.h"
+
+
+Telemetry::Telemetry():m_File(NULL),m_Json(false),m_Header(false),m_Quit(false)
+{
+    pthread_mutex_init(&m_Lock,NULL);
+    pthread_cond_init(&m_Queued,NULL);
+}
+
+Telemetry::~Telemetry()
+{
+    close();
+    pthread_cond_destroy(&m_Queued);
+    pthread_mutex_destroy(&m_Lock);
+}
+
+//Create the file and start the writer thread
+bool Telemetry::open(const char *filename)
+{
+    const char *ext=strrchr(filename,'.');
+
+    close();
+    m_File=fopen(filename,"w");
+    if(!m_File)
+        return false;
+    m_Json=(ext && (!strcmp(ext,".jsonl") || !strcmp(ext,".json")));
+    m_Header=false;
+    m_Quit=false;
+    if(pthread_create(&m_Thread,NULL,writer,this))
+    {
+        fclose(m_File);
+        m_File=NULL;
+        return false;
+    }
+    return true;
+}
+
+//Queue the record for the writer
+void Telemetry::write(const Generation& g)
+{
+    if(!m_File)
+        return;
+    pthread_mutex_lock(&m_Lock);
+    m_Queue.push_back(g);
+    pthread_cond_signal(&m_Queued);
+    pthread_mutex_unlock(&m_Lock);
+}
+
+//Let the writer drain the queue and wait for it to finish
+void Telemetry::close()
+{
+    if(!m_File)
+        return;
+    pthread_mutex_lock(&m_Lock);
+    m_Quit=true;
+    pthread_cond_signal(&m_Queued);
+    pthread_mutex_unlock(&m_Lock);
+    pthread_join(m_Thread,NULL);
+    fclose(m_File);
+    m_File=NULL;
+}
+
+//Writer thread: formats the queued records, the lock is not held while writing
+void *Telemetry::writer(void *p)
+{
+    Telemetry *t=(Telemetry *)p;
+
+    pthread_mutex_lock(&t->m_Lock);
+    while(true)
+    {
+        while(t->m_Queue.empty() && !t->m_Quit)
+            pthread_cond_wait(&t->m_Queued,&t->m_Lock);
+        if(t->m_Queue.empty())
+            break; //quit once everything is written
+        Generation g=t->m_Queue.front();
+        t->m_Queue.pop_front();
+        pthread_mutex_unlock(&t->m_Lock);
+        t->format(g);
+        pthread_mutex_lock(&t->m_Lock);
+    }
+    pthread_mutex_unlock(&t->m_Lock);
+    return NULL;
+}
+
+//Write the record as a line of the file
+//fitness is INFINITY if there is no valid genome, JSON has no literal for it
+void Telemetry::format(const Generation& g)
+{
+    if(m_Json)
+    {
+        fprintf(m_File,"{\"generation\":%d",g.generation);
+        const char *names[]={"best","median","worst"};
+        const double values[]={g.best,g.median,g.worst};
+        for(int i=0;i<3;i++)
+        {
+            if(isinf(values[i]) || isnan(values[i]))
+                fprintf(m_File,",\"%s\":null",names[i]);
+            else
+                fprintf(m_File,",\"%s\":%.17g",names[i],values[i]);
+        }
+        fprintf(m_File,",\"diversity\":%g,\"evaluations\":%d,\"hits\":%d,\"invalid\":%d",
+                g.diversity,g.evaluations,g.hits,g.invalid);
+        fprintf(m_File,",\"breed\":%.6f,\"dispatch\":%.6f,\"wait\":%.6f,\"sort\":%.6f,\"utilization\":[",
+                g.breed,g.dispatch,g.wait,g.sort);
+        for(int i=0;i<g.utilization.size();i++)
+            fprintf(m_File,"%s%.4f",(i?",":""),g.utilization[i]);
+        fprintf(m_File,"]}\n");
+    }
+    else
+    {
+        if(!m_Header)
+        {
+            fprintf(m_File,"generation,best,median,worst,diversity,evaluations,hits,invalid,breed,dispatch,wait,sort,utilization\n");
+            m_Header=true;
+        }
+        fprintf(m_File,"%d,%.17g,%.17g,%.17g,%g,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,",
+                g.generation,g.best,g.median,g.worst,g.diversity,g.evaluations,g.hits,g.invalid,
+                g.breed,g.dispatch,g.wait,g.sort);
+        //one column for all the ranks, separated so as not to break the columns
+        for(int i=0;i<g.utilization.size();i++)
+            fprintf(m_File,"%s%.4f",(i?";":""),g.utilization[i]);
+        fprintf(m_File,"\n");
+    }
+    fflush(m_File);
+}
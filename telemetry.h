@@ -0,0 +1,54 @@
+//Telemetry class writes a record per generation of the GA
+//to a file, formatting and writing happen on a background thread
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <pthread.h>
+
+
+//Records are written as JSON Lines if the file name ends in .jsonl or .json,
+//as CSV with a header line otherwise
+class Telemetry
+{
+    public:
+        //Generation - what is recorded of a generation
+        struct Generation
+        {
+            Generation():generation(0),best(0.0),median(0.0),worst(0.0),diversity(0.0),
+                         evaluations(0),hits(0),invalid(0),breed(0.0),dispatch(0.0),wait(0.0),sort(0.0) {}
+
+            int generation; //0 for the initial population
+            double best,median,worst; //fitness of the valid genomes
+            double diversity; //mean spread of the alleles over the valid genomes
+            int evaluations; //workitems evaluated
+            int hits; //experiments answered from the residual caches
+            int invalid; //genomes without a valid fitness
+            double breed,dispatch,wait,sort; //wall time in seconds
+            std::vector<double> utilization; //busy fraction of every rank
+        };
+
+        Telemetry();
+        ~Telemetry();
+
+        bool open(const char *filename); //start the writer, false if the file cannot be created
+        void write(const Generation& g); //queue the record, returns at once
+        void close(); //write the records queued and stop the writer
+
+    private:
+        static void *writer(void *p);
+        void format(const Generation& g);
+
+        FILE *m_File;
+        bool m_Json;
+        bool m_Header; //CSV header has been written
+        pthread_mutex_t m_Lock;
+        pthread_cond_t m_Queued; //signalled when a record is queued or on close
+        pthread_t m_Thread;
+        std::deque<Generation> m_Queue;
+        bool m_Quit;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#include "threadpool.h"
+
+
+ThreadPool::ThreadPool():m_pTasks(NULL),m_Next(0),m_Running(0),m_Batch(0),m_Quit(false)
+{
+    pthread_mutex_init(&m_Lock,NULL);
+    pthread_cond_init(&m_Work,NULL);
+    pthread_cond_init(&m_Done,NULL);
+}
+
+ThreadPool::~ThreadPool()
+{
+    pthread_mutex_lock(&m_Lock);
+    m_Quit=true;
+    pthread_cond_broadcast(&m_Work);
+    pthread_mutex_unlock(&m_Lock);
+    for(int i=0;i<m_Threads.size();i++)
+        pthread_join(m_Threads[i],NULL);
+    pthread_cond_destroy(&m_Done);
+    pthread_cond_destroy(&m_Work);
+    pthread_mutex_destroy(&m_Lock);
+}
+
+//Start n-1 threads, the caller of run() is the n-th one
+void ThreadPool::start(int n)
+{
+    for(int i=m_Threads.size()+1;i<n;i++)
+    {
+        pthread_t t;
+
+        if(pthread_create(&t,NULL,worker,this))
+            break; //carry on with what we have got
+        m_Threads.push_back(t);
+    }
+}
+
+//Run the batch of tasks, returns when all of them are complete
+void ThreadPool::run(std::vector<Task *>& tasks)
+{
+    pthread_mutex_lock(&m_Lock);
+    m_pTasks=&tasks;
+    m_Next=0;
+    m_Running=0;
+    m_Batch++;
+    pthread_cond_broadcast(&m_Work);
+    pthread_mutex_unlock(&m_Lock);
+
+    //do our share of work
+    while(next());
+
+    //wait for the tasks picked up by other threads
+    pthread_mutex_lock(&m_Lock);
+    while(m_Running)
+        pthread_cond_wait(&m_Done,&m_Lock);
+    m_pTasks=NULL;
+    pthread_mutex_unlock(&m_Lock);
+}
+
+//Pick the next task of the current batch and run it
+bool ThreadPool::next()
+{
+    Task *t=NULL;
+
+    pthread_mutex_lock(&m_Lock);
+    if(m_pTasks && m_Next<m_pTasks->size())
+    {
+        t=(*m_pTasks)[m_Next++];
+        m_Running++;
+    }
+    pthread_mutex_unlock(&m_Lock);
+    if(!t)
+        return false;
+
+    t->run();
+
+    pthread_mutex_lock(&m_Lock);
+    if(!--m_Running)
+        pthread_cond_broadcast(&m_Done);
+    pthread_mutex_unlock(&m_Lock);
+    return true;
+}
+
+//Thread function: waits for a batch and takes part in running it
+void *ThreadPool::worker(void *p)
+{
+    ThreadPool *pool=(ThreadPool *)p;
+    unsigned long batch=0;
+
+    while(true)
+    {
+        pthread_mutex_lock(&pool->m_Lock);
+        while(!pool->m_Quit && pool->m_Batch==batch)
+            pthread_cond_wait(&pool->m_Work,&pool->m_Lock);
+        batch=pool->m_Batch;
+        bool quit=pool->m_Quit;
+        pthread_mutex_unlock(&pool->m_Lock);
+        if(quit)
+            break;
+        while(pool->next());
+    }
+    return NULL;
+}
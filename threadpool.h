@@ -0,0 +1,46 @@
+//ThreadPool class runs batches of tasks
+//on a fixed set of threads within a rank
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <vector>
+#include <pthread.h>
+
+
+//Task - a unit of work to be run by the pool
+class Task
+{
+    public:
+        virtual ~Task() {}
+        virtual void run()=0;
+};
+
+//Pool of threads processing a batch of tasks at a time
+//the calling thread takes part in processing, so a pool
+//of size n starts n-1 threads
+class ThreadPool
+{
+    public:
+        ThreadPool();
+        ~ThreadPool();
+
+        void start(int n); //start the threads, n is the total number of threads to use
+        int size() const { return m_Threads.size()+1; }
+        void run(std::vector<Task *>& tasks); //run all tasks, returns when all of them are complete
+
+    private:
+        static void *worker(void *p);
+        bool next(); //pick next task and run it, false if none left
+
+        pthread_mutex_t m_Lock;
+        pthread_cond_t m_Work; //signalled when new batch is available
+        pthread_cond_t m_Done; //signalled when the batch is complete
+        std::vector<pthread_t> m_Threads;
+        std::vector<Task *> *m_pTasks; //current batch
+        size_t m_Next; //next task of the batch to run
+        int m_Running; //number of tasks of the batch still running
+        unsigned long m_Batch; //batch counter to wake the threads up
+        bool m_Quit;
+};
+
+#endif
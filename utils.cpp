@@ -3,13 +3,18 @@
 #include <locale>
 #include <vector>
 #include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
 
 // convert wstring to a char string with '_' as default char
 std::string convert(const std::wstring& wstr)
 {
-    std::locale const loc("");	// construct a locale obj set to the env's default
+    static std::locale const loc("");	// locale obj set to the env's default, constructing it is costly
     wchar_t const *from=wstr.c_str();	// ptr to const wide character argument
     std::size_t len=wstr.size();	// number of characters in the wide string argument
     std::vector<char> buffer(len+1);	// init char vector buffer of sufficient length to store the input wstring
@@ -30,6 +35,33 @@ std::wstring convert(const std::string& str)
     return wstr;	// return the translated wstring
 }
 
+// convert UTF-8 encoded string to a wstring
+// invalid sequences are replaced with '_'
+std::wstring convert_utf8(const std::string& str)
+{
+    std::wstring wstr;
+
+    wstr.reserve(str.size());
+    for(std::size_t i=0;i<str.size();)
+    {
+        unsigned char c=str[i++];
+        int more=(c<0x80?0:(c>>5)==0x6?1:(c>>4)==0xe?2:(c>>3)==0x1e?3:-1);	// continuation bytes to follow
+        unsigned long cp=(more>0?c&(0x3f>>more):c);
+
+        for(int k=0;k<more;k++,i++)
+        {
+            if(i>=str.size() || (str[i]&0xc0)!=0x80)
+            {
+                more=-1;
+                break;
+            }
+            cp=(cp<<6)|(str[i]&0x3f);
+        }
+        wstr.push_back(more<0?L'_':(wchar_t)cp);
+    }
+    return wstr;
+}
+
 // rnd_generate
 // generates a random double in [min,max]
 double rnd_generate(double min, double max)
@@ -38,3 +70,83 @@ double rnd_generate(double min, double max)
     return min + r * (max - min);
 }
 
+// monotonic_time
+// seconds elapsed on the monotonic clock since an arbitrary point
+double monotonic_time()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (double)ts.tv_sec+1e-9*(double)ts.tv_nsec;
+}
+
+
+// map_file
+// mappings are kept by the name of the file
+const void *map_file(const std::string& name,size_t& size)
+{
+    static std::map<std::string,std::pair<const void *,size_t> > maps;
+    std::map<std::string,std::pair<const void *,size_t> >::iterator it=maps.find(name);
+    struct stat st;
+    void *p;
+    int fd;
+
+    if(it!=maps.end())
+    {
+        size=it->second.second;
+        return it->second.first;
+    }
+    if((fd=open(name.c_str(),O_RDONLY))<0)
+        return NULL;
+    if(fstat(fd,&st) || !st.st_size)
+    {
+        close(fd);
+        return NULL;
+    }
+    p=mmap(NULL,st.st_size,PROT_READ,MAP_SHARED,fd,0);
+    close(fd);	// the mapping keeps the file
+    if(p==MAP_FAILED)
+        return NULL;
+    size=st.st_size;
+    maps[name]=std::make_pair((const void *)p,size);
+    return p;
+}
+
+
+// Symbols
+// the tables are function statics so that they exist before any other static uses them
+std::vector<std::wstring>& Symbols::names()
+{
+    static std::vector<std::wstring> n;
+    return n;
+}
+
+std::map<std::wstring,int>& Symbols::ids()
+{
+    static std::map<std::wstring,int> i;
+    return i;
+}
+
+int Symbols::id(const std::wstring& name)
+{
+    std::map<std::wstring,int>::iterator it=ids().find(name);
+
+    if(it!=ids().end())
+        return it->second;
+    names().push_back(name);
+    return ids()[name]=names().size()-1;
+}
+
+int Symbols::find(const std::wstring& name)
+{
+    std::map<std::wstring,int>::iterator it=ids().find(name);
+
+    return (it==ids().end()?-1:it->second);
+}
+
+const std::wstring& Symbols::name(int id)
+{
+    static const std::wstring none;
+
+    return ((id>=0 && id<names().size())?names()[id]:none);
+}
@@ -1,6 +1,8 @@
 #ifndef UTILS_H
 #define UTILS_H
 #include <string>
+#include <vector>
+#include <map>
 #include <limits>
 
 #define MAX_DOUBLE std::numeric_limits<double>::max()
@@ -8,10 +10,36 @@
 
 std::string convert(const std::wstring& wstr);	// convert wstring to a char string with '_' as default char
 std::wstring convert(const std::string& str);	// convert string to a wstring
+std::wstring convert_utf8(const std::string& str);	// convert UTF-8 encoded string to a wstring, regardless of the locale
 
 // generate a random double in [min,max]
 double rnd_generate(double min, double max);
 
+// seconds elapsed on a monotonic clock, unaffected by changes of the system time
+double monotonic_time();
+
+// map the file read-only, NULL if it cannot be mapped; size is assigned the size of the file
+// a file is mapped once per process and stays mapped, the pages are shared with other processes mapping it
+const void *map_file(const std::string& name,size_t& size);
+
+
+//Symbols
+//interns names: every distinct name gets a dense integer id, in the order the names are interned
+//names are interned while the configuration is loaded, at run time they are looked up by id
+//only interning modifies the table, so it must not run concurrently with lookups
+class Symbols
+{
+    public:
+        static int id(const std::wstring& name);	// id of the name, interned if new
+        static int find(const std::wstring& name);	// id of the name, -1 if it has not been interned
+        static const std::wstring& name(int id);	// name of the id, empty if unknown
+        static int count() { return names().size(); }
+
+    private:
+        static std::vector<std::wstring>& names();
+        static std::map<std::wstring,int>& ids();
+};
+
 
 //pair_equal_to
 //contains the binary operator to evaluate if a pair is equal to an obj (type of first memb)
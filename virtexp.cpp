@@ -1,9 +1,13 @@
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
 #include "virtexp.h"
 #include "AdvXMLParser.h"
 #include "utils.h"
 #include "cellml_observer.h"
+#include "nativemodel.h"
+#include "profile.h"
 #include <math.h>
 
 
@@ -14,19 +18,97 @@ using namespace iface::cellml_services;
 
 
 #define EPSILON 0.01
+#define TOLERANCE 1e-6		// solver tolerance of full accuracy evaluations
+#define SCREEN_TOLERANCE 1e-3	// default solver tolerance of screening evaluations
+#define TIMEOUT_FACTOR 5.0	// default time limit as a multiple of the percentile
+#define TIMING_PERCENTILE 0.95
+#define TIMING_SAMPLES 200	// durations the percentile is taken over
+#define TIMING_MIN_SAMPLES 20	// durations needed before the limit applies
+#define TIMING_MIN_LIMIT 0.1	// seconds, scheduling noise aside
+#define RESIDUAL_CACHE 10000	// residuals cached per experiment, the cache is emptied once full
+#define TUNE_AGREEMENT 0.01	// relative difference from the reference residual a tuned solver may make
+
+//Assessment data file: the header is followed by rows of native doubles, a time and a target per column,
+//the rows are sorted by time
+#define DATA_MAGIC "VXDATA01"
+struct DataHeader
+{
+    char magic[8];
+    int columns;	// targets per row
+    int rows;
+};
+
+//Schema of no alleles, the one every holder starts from
+const VariablesHolder::Schema *VariablesHolder::Schema::empty()
+{
+    static Schema none;
+
+    return &none;
+}
+
+//Schema of the alleles of s followed by id
+//the extensions are kept so that holders built the same way share their schema
+const VariablesHolder::Schema *VariablesHolder::Schema::extend(const Schema *s,int id)
+{
+    static std::map<std::pair<const Schema *,int>,Schema *> extensions;
+    Schema *&ext=extensions[std::make_pair(s,id)];
+
+    if(!ext)
+    {
+        ext=new Schema(*s);
+        if(ext->slots.size()<=id)
+            ext->slots.resize(id+1,-1);
+        ext->slots[id]=ext->ids.size();
+        ext->ids.push_back(id);
+    }
+    return ext;
+}
+
+//Step types of the integration service by name, the first one is the default
+static const struct { const char *name; iface::cellml_services::ODEIntegrationStepType type; bool tune; } step_types[]=
+{
+    { "BDF_IMPLICIT_1_5_SOLVE",iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE,true },
+    { "ADAMS_MOULTON_1_12",iface::cellml_services::ADAMS_MOULTON_1_12,true },
+    { "RUNGE_KUTTA_2_3",iface::cellml_services::RUNGE_KUTTA_2_3,true },
+    { "RUNGE_KUTTA_FEHLBERG_4_5",iface::cellml_services::RUNGE_KUTTA_FEHLBERG_4_5,true },
+    { "RUNGE_KUTTA_CASH_KARP_4_5",iface::cellml_services::RUNGE_KUTTA_CASH_KARP_4_5,true },
+    { "RUNGE_KUTTA_PRINCE_DORMAND_8_9",iface::cellml_services::RUNGE_KUTTA_PRINCE_DORMAND_8_9,true },
+    { "RUNGE_KUTTA_4",iface::cellml_services::RUNGE_KUTTA_4,false },
+    { "RUNGE_KUTTA_IMPLICIT_4",iface::cellml_services::RUNGE_KUTTA_IMPLICIT_4,false },
+    { "BULIRSCH_STOER_IMPLICIT_BD",iface::cellml_services::BULIRSCH_STOER_IMPLICIT_BD,false },
+    { "GEAR_1",iface::cellml_services::GEAR_1,false },
+    { "GEAR_2",iface::cellml_services::GEAR_2,false }
+};
+#define STEP_TYPES (sizeof(step_types)/sizeof(step_types[0]))
+
+//Tolerances tried by tuning, the first one is the default
+static const double tune_tolerances[]={ TOLERANCE,1e-5,1e-4 };
+#define TUNE_TOLERANCES (sizeof(tune_tolerances)/sizeof(tune_tolerances[0]))
 
 extern ObjRef<iface::cellml_api::CellMLBootstrap> bootstrap; //CellML api bootstrap
 extern ObjRef<iface::cellml_services::CellMLIntegrationService> cis;
 
-VirtualExperiment::VirtualExperiment():m_nResultColumn(-1),m_ReportStep(0.0),m_MaxTime(0),m_Accuracy(EPSILON)
+VirtualExperiment::VirtualExperiment():m_pNative(NULL),m_nResultColumn(-1),m_Members(1),m_ReportStep(0.0),m_MaxTime(0),m_Accuracy(EPSILON),
+                                       m_Fidelity(FIDELITY_FULL),m_ScreenTolerance(SCREEN_TOLERANCE),m_ScreenReportStep(0.0),
+                                       m_StepType(step_types[0].type),m_Tolerance(TOLERANCE),m_Tune(false),
+                                       m_TimeoutFactor(TIMEOUT_FACTOR),m_Timeouts(0),m_Hits(0)
 {
 }
 
 VirtualExperiment::~VirtualExperiment()
 {
+    delete m_pNative;
+}
+
+static bool first_less(const std::pair<double,double>& a,const std::pair<double,double>& b)
+{
+    return (a.first<b.first);
 }
 
-VirtualExperiment *VirtualExperiment::LoadExperiment(const AdvXMLParser::Element& elem)
+//Load the experiment described by the XML element
+//alleles holds the names of the variables set by the GA
+//models found in sources are instantiated from memory rather than loaded from their files
+VirtualExperiment *VirtualExperiment::LoadExperiment(const AdvXMLParser::Element& elem,VariablesHolder& alleles,const SOURCES *sources)
 {
     VirtualExperiment *vx=NULL;
 
@@ -36,7 +118,7 @@ VirtualExperiment *VirtualExperiment::LoadExperiment(const AdvXMLParser::Element
     if(!strName.size())
         return NULL;
     vx=new VirtualExperiment;
-    if(!vx->LoadModel(strName))
+    if(!vx->LoadModel(strName,sources))
     {
         delete vx;
         vx=NULL;
@@ -49,17 +131,79 @@ VirtualExperiment *VirtualExperiment::LoadExperiment(const AdvXMLParser::Element
               vx->m_Accuracy=atof(elem.GetAttribute("Accuracy").GetValue().c_str());
        
         vx->m_MaxTime=atoi(elem.GetAttribute("MaxSecondsForSimulation").GetValue().c_str());
+        if(elem.GetAttribute("TimeoutFactor").GetValue().size())
+              vx->m_TimeoutFactor=atof(elem.GetAttribute("TimeoutFactor").GetValue().c_str());
         vx->m_ReportStep=atof(elem.GetAttribute("ReportStep").GetValue().c_str());
-        for(int i=0;;i++)
+        if(elem.GetAttribute("ScreenTolerance").GetValue().size())
+              vx->m_ScreenTolerance=atof(elem.GetAttribute("ScreenTolerance").GetValue().c_str());
+        vx->m_ScreenReportStep=atof(elem.GetAttribute("ScreenReportStep").GetValue().c_str());
+        if(elem.GetAttribute("Tolerance").GetValue().size())
+              vx->m_Tolerance=atof(elem.GetAttribute("Tolerance").GetValue().c_str());
+        //solver of the integration service, "auto" to have it picked by tuning
+        string step=elem.GetAttribute("StepType").GetValue();
+        if(autosolver(elem))
+            vx->m_Tune=true;
+        else if(step.size())
+        {
+            int k=0;
+            for(;k<STEP_TYPES && step!=step_types[k].name;k++);
+            if(k<STEP_TYPES)
+                vx->m_StepType=step_types[k].type;
+            else
+                fprintf(stderr,"Unknown step type %s, using %s\n",step.c_str(),step_types[0].name);
+        }
+        //read the assessment points of every observable, all of them are scored from the same integration
+        //a set may override ResultColumn of the experiment and weight its deviations
+        for(int k=0;;k++)
         {
-            const AdvXMLParser::Element& al=elem("AssessmentPoints",0)("AssessmentPoint",i);
-            POINT pt;
+            const AdvXMLParser::Element& set=elem("AssessmentPoints",k);
+            std::vector<std::pair<double,double> > points;
+            OBSERVABLE o;
 
-            if(al.IsNull())
+            if(set.IsNull())
+                break;
+            o.column=vx->m_nResultColumn;
+            if(set.GetAttribute("ResultColumn").GetValue().size())
+                o.column=atoi(set.GetAttribute("ResultColumn").GetValue().c_str());
+            o.weight=1.0;
+            o.member=0;
+            if(set.GetAttribute("Weight").GetValue().size())
+                o.weight=atof(set.GetAttribute("Weight").GetValue().c_str());
+            for(int i=0;;i++)
+            {
+                const AdvXMLParser::Element& al=set("AssessmentPoint",i);
+
+                if(al.IsNull())
+                    break;
+                points.push_back(std::make_pair(atof(al.GetAttribute("time").GetValue().c_str()),
+                                                atof(al.GetAttribute("target").GetValue().c_str())));
+            }
+            std::stable_sort(points.begin(),points.end(),first_less);
+
+            std::vector<double>& rows=*vx->m_Points.insert(vx->m_Points.end(),std::vector<double>());
+            for(int i=0;i<points.size();i++)
+            {
+                rows.push_back(points[i].first);
+                rows.push_back(points[i].second);
+            }
+            o.rows=(rows.empty()?NULL:&rows[0]);
+            o.stride=2;
+            o.target=1;
+            o.count=points.size();
+            vx->m_Observables.push_back(o);
+        }
+        //assessment data files, every column of targets is an observable
+        for(int k=0;;k++)
+        {
+            const AdvXMLParser::Element& data=elem("AssessmentData",k);
+
+            if(data.IsNull())
                 break;
-            pt.first=atof(al.GetAttribute("time").GetValue().c_str());
-            pt.second=atof(al.GetAttribute("target").GetValue().c_str());
-            vx->m_Timepoints.push_back(pt);
+            if(!vx->LoadData(data))
+            {
+                delete vx;
+                return NULL;
+            }
         }
         //read parameters
         for(int i=0;;i++)
@@ -73,23 +217,285 @@ VirtualExperiment *VirtualExperiment::LoadExperiment(const AdvXMLParser::Element
             if(name.size())
                 vx->m_Parameters[name]=val;
         }
+        vx->dependencies(alleles);
+        vx->Assign();	// parameters stay for the whole run
+        //compiled model code instead of the integration service
+        if(elem.GetAttribute("Backend").GetValue()=="native" && !vx->LoadNative(alleles))
+            fprintf(stderr,"Model %s falls back to the integration service\n",strName.c_str());
     }
     
     return vx;
 }
 
-double VirtualExperiment::getSSRD(std::vector<std::pair<int,double> >& d)
+//The integration service is shared by all the threads of the rank and is not known to be thread-safe:
+//compiling models and creating runs are serialised, a run then works on objects of its own
+static pthread_mutex_t cis_lock=PTHREAD_MUTEX_INITIALIZER;
+
+struct CISLock
+{
+    CISLock() { pthread_mutex_lock(&cis_lock); }
+    ~CISLock() { pthread_mutex_unlock(&cis_lock); }
+};
+
+struct VirtualExperiment::Bound:public ResultsMonitor
+{
+    Bound(VirtualExperiment *p,double b):pOwner(p),bound(b),partial(0.0),final(INFINITY),matched(p->m_Members,0) {}
+    bool examine(const double *rec,int recsize);
+
+    VirtualExperiment *pOwner;
+    double bound;
+    double partial; //residual of the records examined so far
+    double final; //residual the evaluation was aborted at, published before examine returns false
+    std::vector<int> matched; //number of records matching assessment points, per member experiment
+};
+
+//Accumulate deviation of the record if it is an assessment point
+//returns false once the residual exceeds the bound
+//the integration service calls it on the solver thread, the residual is then read by the evaluating
+//thread once it sees the abort: the barrier makes final visible before the abort is flagged
+bool VirtualExperiment::Bound::examine(const double *rec,int recsize)
+{
+    PROFILE(PROF_SCORE);
+    partial+=pOwner->score(rec,matched);
+    if(partial<=bound)
+        return true;
+    final=partial;
+    __sync_synchronize();
+    return false;
+}
+
+//Solver tolerance of the current fidelity
+double VirtualExperiment::tolerance()
+{
+    return (m_Fidelity==FIDELITY_SCREEN?m_ScreenTolerance:m_Tolerance);
+}
+
+//Name of the step type, as the StepType attribute takes it
+const char *VirtualExperiment::stepname(int steptype)
+{
+    for(int k=0;k<STEP_TYPES;k++)
+        if(step_types[k].type==steptype)
+            return step_types[k].name;
+    return "";
+}
+
+//Candidate solvers of tuning: every step type with every tolerance, the c-th one is
+//step type c/TUNE_TOLERANCES with tolerance c%TUNE_TOLERANCES
+int VirtualExperiment::candidates()
+{
+    return STEP_TYPES*TUNE_TOLERANCES;
+}
+
+bool VirtualExperiment::candidate(int c,int& steptype,double& tolerance)
+{
+    if(c<0 || c>=candidates() || !step_types[c/TUNE_TOLERANCES].tune)
+        return false;
+    steptype=step_types[c/TUNE_TOLERANCES].type;
+    tolerance=tune_tolerances[c%TUNE_TOLERANCES];
+    return true;
+}
+
+//Whether the solver of the experiment defined by elem is picked by tuning
+bool VirtualExperiment::autosolver(const AdvXMLParser::Element& elem)
+{
+    return (elem.GetAttribute("StepType").GetValue()=="auto");
+}
+
+/**
+ *	Evaluate the genome with a candidate solver, as tuning tries it
+ *	
+ *	The evaluation is at full accuracy and bypasses the residual cache, the solver, timing
+ *	and timeouts of the experiment are left as they were. Compiled models have a single step type,
+ *	only the candidates of the default one apply to them.
+ **/
+double VirtualExperiment::trial(VariablesHolder& v,int c)
+{
+    int steptype;
+    double tolerance;
+
+    if(!candidate(c,steptype,tolerance) || (m_pNative && c>=TUNE_TOLERANCES))
+        return NAN;
+
+    Timing timing=m_Timing[FIDELITY_FULL];
+    int timeouts=m_Timeouts;
+    int fidelity=m_Fidelity;
+    int step=m_StepType;
+    double tol=m_Tolerance;
+
+    m_Fidelity=FIDELITY_FULL;
+    m_StepType=steptype;
+    m_Tolerance=tolerance;
+    m_Timing[FIDELITY_FULL].limit=0.0;	// MaxSecondsForSimulation still applies
+    SetVariables(v);
+    double r=Evaluate();
+
+    m_StepType=step;
+    m_Tolerance=tol;
+    m_Fidelity=fidelity;
+    m_Timing[FIDELITY_FULL]=timing;
+    m_Timeouts=timeouts;
+    return r;
+}
+
+/**
+ *	Pick the solver of an experiment from the trials of the candidates on a few genomes
+ *	
+ *	residuals and seconds hold the trials of every candidate on the genomes in turn, NaN residuals
+ *	for trials not made. The residuals of the default solver are the reference; the candidate
+ *	taking the least time whose residuals agree with the reference within TUNE_AGREEMENT is returned.
+ **/
+int VirtualExperiment::choose(const std::vector<double>& residuals,const std::vector<double>& seconds,int genomes)
+{
+    int best=0;
+    double fastest=INFINITY;
+
+    for(int c=0;c<candidates();c++)
+    {
+        double elapsed=0.0;
+        bool agree=true;
+
+        for(int k=0;k<genomes && agree;k++)
+        {
+            double r=residuals[c*genomes+k],ref=residuals[k];
+
+            if(isnan(r) || isnan(ref))
+                agree=false;	// not tried
+            else if(r==INFINITY || ref==INFINITY)
+                agree=(r==ref);
+            else
+                agree=(fabs(r-ref)<=TUNE_AGREEMENT*fabs(ref));
+            elapsed+=seconds[c*genomes+k];
+        }
+        if(agree && elapsed<fastest)
+        {
+            fastest=elapsed;
+            best=c;
+        }
+    }
+    return best;
+}
+
+//Report step of the current fidelity, screening falls back to ReportStep
+double VirtualExperiment::reportstep()
+{
+    return ((m_Fidelity==FIDELITY_SCREEN && m_ScreenReportStep)?m_ScreenReportStep:m_ReportStep);
+}
+
+/**
+ *	Map an assessment data file given by the AssessmentData element
+ *	
+ *	File is the path of the data, ResultColumns and Weights are comma separated lists giving the result column
+ *	and the weight of every column of targets; columns not listed follow the last column listed, weight 1.
+ *	The pages of the file are shared by the ranks of a node.
+ **/
+bool VirtualExperiment::LoadData(const AdvXMLParser::Element& elem)
+{
+    string name=elem.GetAttribute("File").GetValue();
+    string columns=elem.GetAttribute("ResultColumns").GetValue();
+    string weights=elem.GetAttribute("Weights").GetValue();
+    size_t size=0;
+    const DataHeader *h=(const DataHeader *)map_file(name,size);
+
+    if(!h || size<sizeof(DataHeader) || memcmp(h->magic,DATA_MAGIC,sizeof(h->magic)) || h->columns<1 || h->rows<0 ||
+       size<sizeof(DataHeader)+sizeof(double)*(size_t)h->rows*(h->columns+1))
+    {
+        fprintf(stderr,"Error reading assessment data %s\n",name.c_str());
+        return false;
+    }
+
+    OBSERVABLE o;
+    const char *c=columns.c_str(),*w=weights.c_str();
+
+    o.rows=(const double *)(h+1);
+    o.stride=h->columns+1;
+    o.count=h->rows;
+    for(int i=1;i<o.count;i++)
+    {
+        if(o.time(i)<o.time(i-1))
+        {
+            fprintf(stderr,"Assessment data %s is not sorted by time\n",name.c_str());
+            return false;
+        }
+    }
+    o.column=m_nResultColumn;
+    o.weight=1.0;
+    o.member=0;
+    for(int k=0;k<h->columns;k++)
+    {
+        if(k && o.column>=0)
+            o.column++;
+        if(*c)
+        {
+            o.column=atoi(c);
+            c+=strcspn(c,",");
+            c+=(*c==',');
+        }
+        o.weight=1.0;
+        if(*w)
+        {
+            o.weight=atof(w);
+            w+=strcspn(w,",");
+            w+=(*w==',');
+        }
+        o.target=k+1;
+        m_Observables.push_back(o);
+    }
+    return true;
+}
+
+//Deviation of the record from the assessment points it matches, counted in matched per member experiment
+//every observable is compared at its first point within EPSILON of the record time
+double VirtualExperiment::score(const double *rec,std::vector<int>& matched)
 {
     double r=0.0;
 
-    for(int i=0;i<d.size();i++)
+    for(int j=0;j<m_Observables.size();j++)
     {
-        r+=pow((d[i].second-m_Timepoints[d[i].first].second)/m_Timepoints[d[i].first].second,2);
+        const OBSERVABLE& o=m_Observables[j];
+        int lo=0,hi=o.count;
+
+        //first point not earlier than EPSILON before the record
+        while(lo<hi)
+        {
+            int mid=(lo+hi)/2;
+
+            if(o.time(mid)<rec[0]-EPSILON)
+                lo=mid+1;
+            else
+                hi=mid;
+        }
+        if(lo<o.count && in_range(rec[0],o.time(lo),EPSILON))
+        {
+            double target=o.value(lo);
+
+            r+=o.weight*pow((rec[o.column]-target)/target,2);
+            matched[o.member]++;
+        }
     }
     return r;
 }
 
-bool VirtualExperiment::LoadModel(const std::string& model_name)
+//An integration assesses the experiments sharing it only if records matched points of every one of them
+bool VirtualExperiment::assessed(const std::vector<int>& matched) const
+{
+    for(int i=0;i<matched.size();i++)
+        if(!matched[i])
+            return false;
+    return true;
+}
+
+//Time of the last assessment point
+double VirtualExperiment::endtime()
+{
+    double end=0.0;
+
+    for(int i=0;i<m_Observables.size();i++)
+        if(m_Observables[i].count && m_Observables[i].time(m_Observables[i].count-1)>end)
+            end=m_Observables[i].time(m_Observables[i].count-1);
+    return end;
+}
+
+bool VirtualExperiment::LoadModel(const std::string& model_name,const SOURCES *sources)
 {
     bool res=false;
 
@@ -98,7 +504,17 @@ bool VirtualExperiment::LoadModel(const std::string& model_name)
  
     try
     {
-        m_Model=bootstrap->modelLoader()->loadFromURL(modelURL); 
+        SOURCES::const_iterator it;
+
+        if(sources && (it=sources->find(model_name))!=sources->end())
+        {
+            //the document is in memory, keep its location for relative imports
+            m_Model=bootstrap->modelLoader()->createFromText(convert_utf8(it->second));
+            ObjRef<iface::cellml_api::URI> base=m_Model->base_uri();
+            base->asText(modelURL);
+        }
+        else
+            m_Model=bootstrap->modelLoader()->loadFromURL(modelURL); 
         res=true;
     }
     catch(CellMLException e)
@@ -109,6 +525,92 @@ bool VirtualExperiment::LoadModel(const std::string& model_name)
     return res;
 }
 
+/**
+ *	Generate and compile the code of the model to be integrated in-process
+ *	
+ *	The alleles are the inputs of the compiled model, the parameters of the experiment
+ *	are compiled in as constants so that the compiler folds them into the equations.
+ *	The model reports at every ReportStep if it is set, at the assessment points otherwise,
+ *	matching the records the integration service would return.
+ **/
+bool VirtualExperiment::LoadNative(VariablesHolder& alleles)
+{
+    std::vector<std::wstring> inputs;
+    PARAMS fixed;	// parameters not overridden by alleles never change
+
+    if(m_Observables.empty())
+        return false;
+    for(int i=0;;i++)
+    {
+        wstring n=alleles.name(i);
+        if(n.empty())
+           break;
+        inputs.push_back(n);
+        m_InputIds.push_back(alleles.id(i));
+    }
+    for(PARAMS::iterator it=m_Parameters.begin();it!=m_Parameters.end();++it)
+    {
+        if(!alleles.exists(it->first))
+            fixed.insert(*it);
+    }
+
+    m_pNative=new NativeModel;
+    if(!m_pNative->Build(m_Model,inputs,fixed))
+    {
+        delete m_pNative;
+        m_pNative=NULL;
+        return false;
+    }
+
+    reporttimes();
+    return true;
+}
+
+//Times the compiled model reports at: every ReportStep if it is set, the assessment points otherwise
+void VirtualExperiment::reporttimes()
+{
+    m_Times.clear();
+    double end=endtime();
+    for(int i=0;i<m_Observables.size();i++)
+        for(int k=0;k<m_Observables[i].count;k++)
+            m_Times.push_back(m_Observables[i].time(k));
+    if(m_ReportStep>0.0)
+    {
+        m_Times.clear();
+        for(int k=0;k*m_ReportStep<end+m_ReportStep*0.5;k++)
+            m_Times.push_back(k*m_ReportStep);
+    }
+    std::sort(m_Times.begin(),m_Times.end());
+    m_Times.erase(std::unique(m_Times.begin(),m_Times.end()),m_Times.end());
+}
+
+//Experiments integrate the same system the same way if they share the model, the parameters
+//and the settings of the integration; they may differ in what they are assessed against
+bool VirtualExperiment::identical(const VirtualExperiment& other) const
+{
+    return (m_strModelName==other.m_strModelName && m_Parameters==other.m_Parameters &&
+            (m_pNative!=NULL)==(other.m_pNative!=NULL) &&
+            m_ReportStep==other.m_ReportStep && m_ScreenReportStep==other.m_ScreenReportStep &&
+            m_ScreenTolerance==other.m_ScreenTolerance &&
+            m_StepType==other.m_StepType && m_Tolerance==other.m_Tolerance && m_Tune==other.m_Tune &&
+            m_MaxTime==other.m_MaxTime && m_TimeoutFactor==other.m_TimeoutFactor);
+}
+
+//Append the assessment points of the other (identical) experiment as observables of this one
+//the residual of this experiment becomes the sum of both, integrated up to the later end time
+void VirtualExperiment::share(VirtualExperiment& other)
+{
+    //the rows stay with the other experiment, which the group keeps
+    for(int i=0;i<other.m_Observables.size();i++)
+    {
+        m_Observables.push_back(other.m_Observables[i]);
+        m_Observables.back().member+=m_Members;
+    }
+    m_Members+=other.m_Members;
+    if(m_pNative)
+        reporttimes();
+}
+
 void VirtualExperiment::SetParameters(VariablesHolder& v)
 {
     for(int i=0;;i++)
@@ -119,11 +621,140 @@ void VirtualExperiment::SetParameters(VariablesHolder& v)
         double val=v(n);
         m_Parameters[n]=val; 
     }
+    //compiled models have the parameters built in
+    if(!m_pNative)
+        Assign();
+}
+
+
+//Find the alleles naming variables of the model, those SetVariables assigns
+//the rest of alleles cannot affect the residual of the experiment
+void VirtualExperiment::dependencies(VariablesHolder& alleles)
+{
+    m_Bindings.clear();
+    m_Defaults.clear();
+
+    ObjRef<iface::cellml_api::CellMLComponentSet> comps=m_Model->modelComponents();
+    ObjRef<iface::cellml_api::CellMLComponentIterator> comps_it=comps->iterateComponents();
+
+    for(ObjRef<iface::cellml_api::CellMLComponent> comp=comps_it->nextComponent();comp;comp=comps_it->nextComponent())
+    {
+        ObjRef<iface::cellml_api::CellMLVariableSet> vars=comp->variables();
+        ObjRef<iface::cellml_api::CellMLVariableIterator> vars_it=vars->iterateVariables();
+        wstring compname=comp->name();
+
+        for(ObjRef<iface::cellml_api::CellMLVariable> var=vars_it->nextVariable();var;var=vars_it->nextVariable())
+        {
+            wstring name=((compname==L"all" || compname.empty())?var->name():compname+L"."+var->name());
+            int id=Symbols::find(name);
+
+            if(id<0 || !alleles.exists(id))
+                continue;
+            m_Bindings.push_back(std::make_pair(id,var));
+
+            //value of the variable for genomes leaving the allele out: the parameter, else the initial value of the model
+            PARAMS::iterator it=m_Parameters.find(name);
+            if(it!=m_Parameters.end())
+                m_Defaults[id]=it->second;
+            else
+            {
+                wstring init=var->initialValue();
+                wchar_t *end;
+                double val=wcstod(init.c_str(),&end);
+
+                m_Defaults[id]=(end!=init.c_str()?val:0.0);
+            }
+        }
+    }
+
+    m_Relevant.clear();
+    for(int i=0;alleles.id(i)>=0;i++)
+    {
+        for(int k=0;k<m_Bindings.size();k++)
+        {
+            if(m_Bindings[k].first==alleles.id(i))
+            {
+                m_Relevant.push_back(alleles.id(i));
+                break;
+            }
+        }
+    }
+}
+
+//Value of the allele of id for the model
+//a genome of a job not searching the allele holds NaN, the model then keeps its own value
+double VirtualExperiment::input(VariablesHolder& v,int id)
+{
+    double val=v(id);
+
+    if(!isnan(val))
+        return val;
+    std::map<int,double>::iterator it=m_Defaults.find(id);
+    return (it==m_Defaults.end()?0.0:it->second);
+}
+
+//Build the cache key of the genome: fidelity and the values of the relevant alleles
+void VirtualExperiment::key(VariablesHolder& v)
+{
+    m_Key.clear();
+    m_Key.push_back(m_Fidelity);
+    for(int i=0;i<m_Relevant.size();i++)
+        m_Key.push_back(input(v,m_Relevant[i]));
+}
+
+//Look the residual of the genome up
+//an exact residual is always known, a lower bound only if it exceeds bound as well
+bool VirtualExperiment::cached(VariablesHolder& v,double bound,double& res)
+{
+    key(v);
+    RESIDUALS::iterator it=m_Residuals.find(m_Key);
+    if(it==m_Residuals.end() || (!it->second.exact && it->second.value<=bound))
+        return false;
+    res=it->second.value;
+    m_Hits++;
+    return true;
 }
 
+//Cache the residual of the genome evaluated within bound
+//failures are not cached as they may be down to the time limit
+void VirtualExperiment::remember(VariablesHolder& v,double bound,double res)
+{
+    if(res==INFINITY)
+        return;
+    if(m_Residuals.size()>=RESIDUAL_CACHE)
+        m_Residuals.clear();
+
+    key(v);
 
-// TODO
+    Residual& r=m_Residuals[m_Key];
+    r.value=res;
+    r.exact=(res<=bound);
+}
+
+//Set the alleles of the genome as the values of the model variables
+//parameters have been set once the experiment was loaded, those alleles override them
 void VirtualExperiment::SetVariables(VariablesHolder& v)
+{
+    PROFILE(PROF_SET_VARIABLES);
+    if(m_pNative)
+    {
+        for(int i=0;i<m_InputIds.size();i++)
+            m_pNative->set(i,input(v,m_InputIds[i]));
+        return;
+    }
+    for(int k=0;k<m_Bindings.size();k++)
+    {
+        if(!v.exists(m_Bindings[k].first))
+            continue;
+
+        char sss[120];
+        gcvt(input(v,m_Bindings[k].first),25,sss);
+        m_Bindings[k].second->initialValue(convert(sss));
+    }
+}
+
+//Set the initial values of the model variables named by the parameters
+void VirtualExperiment::Assign()
 {
     ObjRef<iface::cellml_api::CellMLComponentSet> comps=m_Model->modelComponents();
     ObjRef<iface::cellml_api::CellMLComponentIterator> comps_it=comps->iterateComponents();
@@ -149,14 +780,7 @@ void VirtualExperiment::SetVariables(VariablesHolder& v)
                 fullname=convert(compname)+convert(".");
                 fullname+=name;
             }
-            if(v.exists(fullname))
-            {
-                char sss[120];
-                gcvt(v(fullname),25,sss);
-                std::wstring wv=convert(sss);
-                var->initialValue(wv);
-            }
-            else if(m_Parameters.find(fullname)!=m_Parameters.end())
+            if(m_Parameters.find(fullname)!=m_Parameters.end())
             {
                 char sss[120];
                 gcvt(m_Parameters[fullname],25,sss);
@@ -169,64 +793,89 @@ void VirtualExperiment::SetVariables(VariablesHolder& v)
     }
 }
 
-double VirtualExperiment::Evaluate()
+//Evaluate the residual of the model against the assessment points
+//if the residual exceeds bound the integration is aborted
+//and the partial residual (greater than bound) is returned
+double VirtualExperiment::Evaluate(double bound)
 {
+    if(m_pNative)
+        return EvaluateNative(bound);
+
     double res=0.0;
     //int j=0;
     ObjRef<iface::cellml_services::ODESolverCompiledModel> compiledModel;
     ObjRef<iface::cellml_services::ODESolverRun> osr;
-    time_t calc_started;
+    double calc_started;
+    double limit=timelimit();
 
     try
     {
-       compiledModel=cis->compileModelODE(m_Model);
-       osr=cis->createODEIntegrationRun(compiledModel);
+       {
+           CISLock lock;	// the integration service is shared by the threads of the rank
+           //the values of the variables are compiled in, so the code is compiled on every evaluation:
+           //only the native backend caches the code of a model
+           {
+               PROFILE(PROF_COMPILE);
+               compiledModel=cis->compileModelODE(m_Model);
+           }
+           {
+               PROFILE(PROF_CREATE_RUN);
+               osr=cis->createODEIntegrationRun(compiledModel);
+           }
+       }
        LocalProgressObserver *po=new LocalProgressObserver(compiledModel);
+       Bound *b=NULL;
 
+       if(bound!=INFINITY)
+            po->monitor(b=new Bound(this,bound)); //owned by the observer
        osr->setProgressObserver(po);
        po->release_ref();
-       osr->stepType(iface::cellml_services::BDF_IMPLICIT_1_5_SOLVE);
-       osr->setStepSizeControl(1e-6,1e-6,1.0,0.0,1.0);
-       osr->setResultRange(0.0,m_Timepoints[m_Timepoints.size()-1].first,m_Timepoints[m_Timepoints.size()-1].first);
-       if(m_ReportStep)
-            osr->setTabulationStepControl(m_ReportStep,true);
+       osr->stepType((iface::cellml_services::ODEIntegrationStepType)m_StepType);
+       osr->setStepSizeControl(tolerance(),tolerance(),1.0,0.0,1.0);
+       osr->setResultRange(0.0,endtime(),endtime());
+       if(reportstep())
+            osr->setTabulationStepControl(reportstep(),true);
 
-       calc_started=time(NULL);
+       calc_started=monotonic_time();
        osr->start();
-       while(!po->finished())
        {
-           usleep(1000);
-           if(m_MaxTime)
+           PROFILE(PROF_SOLVER);
+           while(!po->finished())
            {
-               time_t t=time(NULL);
-               if((unsigned long)(t-calc_started)>m_MaxTime)
+               usleep(1000);
+               if(po->aborted())
+               {
+                   //no point to carry on, the fit is worse than the bound already
+                   osr->stop();
+                   __sync_synchronize();	// pairs with the barrier of Bound::examine
+                   return b->final;
+               }
+               if(limit && monotonic_time()-calc_started>limit)
                {
+                   //free the core rather than leaving the integration running
+                   osr->stop();
                    po->failed("Took too long to integrate");
-                   throw CellMLException();
+                   m_Timeouts++;
+                   return INFINITY;
                }
            }
-       }      
+       }
 
        if(!po->failed())
        {
+           timed(monotonic_time()-calc_started);
+           PROFILE(PROF_RESULTS);
            std::vector<double> vd;
-           std::vector<std::pair<int,double> > results;
+           std::vector<int> matched(m_Members,0);
            int recsize=po->GetResults(vd);
  
            for(int i=0;i<vd.size();i+=recsize)
+               res+=score(&vd[i],matched);
+           if(!assessed(matched))
            {
-               for(int j=0;j<m_Timepoints.size();j++)
-                   if(in_range(vd[i],m_Timepoints[j].first,EPSILON))
-                   {
-                       results.push_back(make_pair(j,vd[i+m_nResultColumn]));
-                       break;
-                   }
-           }
-           if(!results.size())
-           {
-               fprintf(stderr,"Results vector is empty, Observer returned %d bytes (%d records)\n",vd.size(),vd.size()/recsize);
+               fprintf(stderr,"Results miss the assessment points, Observer returned %d bytes (%d records)\n",vd.size(),vd.size()/recsize);
+               res=INFINITY;
            }
-           res=(results.size()?getSSRD(results):INFINITY);
        }
        else
            res=INFINITY;
@@ -240,6 +889,172 @@ double VirtualExperiment::Evaluate()
 }
 
 
+//Evaluate the residual integrating the compiled model in-process
+double VirtualExperiment::EvaluateNative(double bound)
+{
+    Bound b(this,bound);
+
+    double started=monotonic_time();
+
+    m_pNative->tolerances(tolerance(),tolerance(),1.0);
+    PROFILE(PROF_NATIVE);
+    if(!m_pNative->Run(m_Times,b,timelimit()))
+    {
+        if(m_pNative->timedout())
+            m_Timeouts++;
+        return INFINITY;
+    }
+    if(b.partial>bound)
+        return b.partial;	// aborted
+    timed(monotonic_time()-started);
+    return (assessed(b.matched)?b.partial:INFINITY);
+}
+
+//Time limit of the following integration of the lanes, 0 for none
+//the adaptive limit applies once enough durations are known, MaxSecondsForSimulation caps it
+double VirtualExperiment::timelimit(int lanes)
+{
+    double limit=m_Timing[m_Fidelity].limit*lanes;
+
+    if(m_MaxTime && (!limit || limit>(double)m_MaxTime))
+        limit=(double)m_MaxTime;
+    return limit;
+}
+
+//Record the duration of a complete integration of the lanes
+//the adaptive limit is a multiple of the percentile of the recent durations per lane
+void VirtualExperiment::timed(double seconds,int lanes)
+{
+    Timing& t=m_Timing[m_Fidelity];
+
+    seconds/=lanes;
+    if(t.samples.size()<TIMING_SAMPLES)
+        t.samples.push_back(seconds);
+    else
+    {
+        t.samples[t.next]=seconds;
+        t.next=(t.next+1)%TIMING_SAMPLES;
+    }
+    if(m_TimeoutFactor<=0.0 || t.samples.size()<TIMING_MIN_SAMPLES)
+        return;
+
+    std::vector<double> s(t.samples);
+    std::vector<double>::iterator p=s.begin()+(int)(TIMING_PERCENTILE*(s.size()-1));
+
+    std::nth_element(s.begin(),p,s.end());
+    t.limit=std::max(m_TimeoutFactor*(*p),TIMING_MIN_LIMIT);
+}
+
+
+void VirtualExperiment::lanes(int n)
+{
+    if(m_pNative)
+        m_pNative->lanes(n);
+}
+
+//Evaluate the residual of the genome, giving up once it exceeds bound
+//genomes not differing in the alleles the model depends on share the residual
+double VirtualExperiment::Evaluate(VariablesHolder& v,double bound)
+{
+    double res;
+
+    if(cached(v,bound,res))
+        return res;
+    SetVariables(v);
+    res=Evaluate(bound);
+    remember(v,bound,res);
+    return res;
+}
+
+/**
+ *	Evaluate the residuals of several genomes, giving up on a genome once its residual exceeds its bound
+ *	
+ *	Residuals of genomes already known are taken from the cache, the rest are integrated.
+ **/
+void VirtualExperiment::Evaluate(std::vector<VariablesHolder *>& v,std::vector<double>& bound,std::vector<double>& res)
+{
+    std::vector<VariablesHolder *> mv;	// genomes missing in the cache
+    std::vector<double> mb,mr;
+    std::vector<int> mi;
+
+    res.resize(v.size());
+    for(int k=0;k<v.size();k++)
+    {
+        if(cached(*v[k],bound[k],res[k]))
+            continue;
+        mv.push_back(v[k]);
+        mb.push_back(bound[k]);
+        mi.push_back(k);
+    }
+    if(mv.empty())
+        return;
+
+    EvaluateLanes(mv,mb,mr);
+    for(int j=0;j<mi.size();j++)
+    {
+        res[mi[j]]=mr[j];
+        remember(*mv[j],mb[j],mr[j]);
+    }
+}
+
+/**
+ *	Integrate several genomes
+ *	
+ *	Compiled models integrate the genomes in lockstep, a lane per genome.
+ *	Otherwise the genomes are evaluated one after another.
+ **/
+void VirtualExperiment::EvaluateLanes(std::vector<VariablesHolder *>& v,std::vector<double>& bound,std::vector<double>& res)
+{
+    res.resize(v.size());
+    if(!m_pNative || v.size()<2 || v.size()>m_pNative->lanes())
+    {
+        for(int k=0;k<v.size();k++)
+        {
+            SetVariables(*v[k]);
+            res[k]=Evaluate(bound[k]);
+        }
+        return;
+    }
+
+    std::vector<Bound> b;
+    std::vector<ResultsMonitor *> m;
+    for(int k=0;k<v.size();k++)
+    {
+        for(int i=0;i<m_InputIds.size();i++)
+            m_pNative->set(k,i,input(*v[k],m_InputIds[i]));
+        b.push_back(Bound(this,bound[k]));
+    }
+    for(int k=0;k<b.size();k++)
+        m.push_back(&b[k]);
+
+    double started=monotonic_time();
+    bool complete=true;
+
+    m_pNative->tolerances(tolerance(),tolerance(),1.0);
+    bool ok;
+    {
+        PROFILE(PROF_NATIVE);
+        ok=m_pNative->Run(m_Times,m,timelimit(v.size()));
+    }
+    if(!ok && m_pNative->timedout())
+        m_Timeouts+=v.size();
+    for(int k=0;k<v.size();k++)
+    {
+        if(!ok || m_pNative->failed(k))
+            res[k]=INFINITY;
+        else if(b[k].partial>bound[k])
+        {
+            res[k]=b[k].partial;	// aborted
+            complete=false;
+        }
+        else
+            res[k]=(assessed(b[k].matched)?b[k].partial:INFINITY);
+    }
+    if(ok && complete)
+        timed(monotonic_time()-started,v.size());
+}
+
+
 double VirtualExperiment::Runner::operator()(VariablesHolder& v)
 {
     pOwner->SetVariables(v);
@@ -247,7 +1062,26 @@ double VirtualExperiment::Runner::operator()(VariablesHolder& v)
 }
 
 
-VEGroup::VEGroup()
+struct VEGroup::Trial:public Task
+{
+    Trial(VEGroup *p,VirtualExperiment *x):pOwner(p),vx(x),v(NULL),result(0.0) {}
+    void run();
+
+    VEGroup *pOwner;
+    VirtualExperiment *vx;
+    VariablesHolder *v;
+    double result;
+};
+
+//Evaluate the experiment within the total residual of the group
+//the bound does not depend on the other trials, so neither does the result
+void VEGroup::Trial::run()
+{
+    result=vx->Evaluate(*v,pOwner->m_Total);
+}
+
+
+VEGroup::VEGroup():m_Total(0.0)
 {
 }
 
@@ -273,38 +1107,268 @@ VEGroup& VEGroup::instance()
  *	
  *	INFINITY is an exception returned when particularly poor fit against experiment
  *	0.0 returned when the VEGroup object contains no virtual experiments
+ *
+ *	As residuals only add up, evaluation stops as soon as the average deviation is known to exceed bound:
+ *		bounded is set and the lower estimate of the average deviation (greater than bound) is returned
+ *	A failed experiment fails the evaluation at once, bounded or not
  **/
-double VEGroup::Evaluate(VariablesHolder& v)
+double VEGroup::Evaluate(VariablesHolder& v,double bound,bool& bounded)
 {
     double res=0.0;
-    int count=0;	// counter for the number of experiments that yielded a finite residual
+    double total=bound*experiments.size();	// the total residual must stay within
 
+    bounded=false;
     if(!experiments.size())
         return 0.0;	// no virtual experiments to reference
 
-    for(int i=0;i<experiments.size();i++)
+    if(m_Trials.size()==runs.size())
+        return EvaluateParallel(v,bound,bounded);
+
+    for(int i=0;i<runs.size();i++)
     {
-		// set variables to compare against experiment
-        experiments[i]->SetVariables(v);
+		// evaluate residual from this experiment, within what is left of the total
+        double d=runs[i]->Evaluate(v,total-res);	//??? residual method	TODO
 
-		// evaluate residual from this experiment 
-        double d=experiments[i]->Evaluate();	//??? residual method	TODO
+		// a failure is not made up for by the rest of experiments
+        if(d==INFINITY)
+        {
+            bounded=false;
+            return INFINITY;
+        }
+        res+=d;	// update the total residual
 
-		// update the total residual
-        if(d!=INFINITY)
+		// the rest of experiments cannot make it any better
+        if(res>total)
         {
-            res+=d;
-            count++;
+            bounded=true;
+            return res/(double)experiments.size();
         }
     }
 
 	// return this param list's average deviation evaluated from all virtual experiments
-    return (count==experiments.size()?res/(double)count:INFINITY);
+    return res/(double)experiments.size();
+}
+
+
+/**
+ *	Evaluate the fit of the first n genomes of v together, experiment by experiment
+ *	
+ *	Same as evaluating each of them on its own: res holds the average deviations,
+ *	a genome stops being evaluated once its residual is known to exceed its bound or an experiment fails it
+ **/
+void VEGroup::Evaluate(std::vector<VariablesHolder>& v,int n,std::vector<double>& bound,std::vector<double>& res,std::vector<bool>& bounded)
+{
+    std::vector<bool> failed(n,false);
+    std::vector<double> total(n);
+    std::vector<int> active;	// genomes still being evaluated
+    std::vector<VariablesHolder *> vars;
+    std::vector<double> budget,d;
+
+    res.assign(n,0.0);
+    bounded.assign(n,false);
+    for(int k=0;k<n;k++)
+        total[k]=bound[k]*experiments.size();
+
+    for(int i=0;i<runs.size();i++)
+    {
+        active.clear();
+        vars.clear();
+        budget.clear();
+        for(int k=0;k<n;k++)
+        {
+            if(bounded[k] || failed[k])
+                continue;
+            active.push_back(k);
+            vars.push_back(&v[k]);
+            budget.push_back(total[k]-res[k]);
+        }
+        if(active.empty())
+            break;
+
+        runs[i]->Evaluate(vars,budget,d);
+
+        for(int j=0;j<active.size();j++)
+        {
+            int k=active[j];
+
+            if(d[j]==INFINITY)
+                failed[k]=true;
+            else
+            {
+                res[k]+=d[j];
+                bounded[k]=(res[k]>total[k]);
+            }
+        }
+    }
+
+    for(int k=0;k<n;k++)
+    {
+        if(failed[k])
+        {
+            bounded[k]=false;
+            res[k]=INFINITY;
+        }
+        else
+            res[k]=res[k]/(experiments.size()?(double)experiments.size():1.0);
+    }
+}
+
+
+/**
+ *	Evaluate a model's fit against data from a single experiment of the group
+ *	
+ *	Returns the residual of the experiment (not averaged), INFINITY if the evaluation failed
+ *	or the experiment is not in the group. If the residual exceeds bound, bounded is set
+ **/
+double VEGroup::Evaluate(VariablesHolder& v,int experiment,double bound,bool& bounded)
+{
+    bounded=false;
+    if(experiment<0 || experiment>=experiments.size() || !experiments[experiment])
+        return INFINITY;
+
+    double d=experiments[experiment]->Evaluate(v,bound);
+
+    bounded=(d!=INFINITY && d>bound);
+    return d;
+}
+
+
+/**
+ *	Evaluate the experiments of the group on the thread pool
+ *	
+ *	Every experiment owns its model, so concurrent trials never share one.
+ *	A trial is aborted only once its own residual exceeds the total the group must stay within,
+ *	and the residuals are summed in the order of experiments once all trials are complete:
+ *	the result and bounded do not depend on the order the trials have finished in.
+ *	The price is that a trial cannot stop early on the residuals of the others.
+ *	A failed trial fails the evaluation, bounded or not.
+ **/
+double VEGroup::EvaluateParallel(VariablesHolder& v,double bound,bool& bounded)
+{
+    double res=0.0;
+
+    m_Total=bound*experiments.size();
+    for(int i=0;i<m_Trials.size();i++)
+        m_Trials[i].v=&v;
+
+    m_Pool.run(m_Tasks);
+
+    for(int i=0;i<m_Trials.size();i++)
+    {
+        if(m_Trials[i].result==INFINITY)
+            return INFINITY;	// bounded stays false, a failure is not a lower estimate
+        res+=m_Trials[i].result;
+    }
+
+	// some of experiments cannot make it any better
+    bounded=(res>m_Total);
+    return res/(double)experiments.size();
 }
 
 
+//Add the experiment, NULL stands for an experiment evaluated by other ranks only
 void VEGroup::add(VirtualExperiment *p)
 {
     experiments.push_back(p);
+    if(p)
+        runs.push_back(p);
+}
+
+//Group the experiments integrating the same system, the first of a group
+//scores the assessment points of the rest from its own integration
+//the experiments are evaluated on their own no more, so this does not go with splitting them
+void VEGroup::share()
+{
+    runs.clear();
+    for(int i=0;i<experiments.size();i++)
+    {
+        int j=0;
+
+        if(!experiments[i])
+            continue;
+        for(;j<runs.size();j++)
+            if(runs[j]->identical(*experiments[i]))
+                break;
+        if(j<runs.size())
+            runs[j]->share(*experiments[i]);
+        else
+            runs.push_back(experiments[i]);
+    }
+}
+
+//Allocate the experiments to evaluate n genomes together
+void VEGroup::lanes(int n)
+{
+    for(int i=0;i<runs.size();i++)
+        runs[i]->lanes(n);
+}
+
+//Set the accuracy of the following evaluations
+void VEGroup::fidelity(int f)
+{
+    for(int i=0;i<runs.size();i++)
+        runs[i]->fidelity(f);
+}
+
+//Start the thread pool and create a trial for every experiment
+//must be called once all the experiments are added
+void VEGroup::threads(int n)
+{
+    if(n<2 || runs.size()<2)
+        return;		// nothing to gain, evaluate sequentially
+    if(n>runs.size())
+        n=runs.size();
+    m_Pool.start(n);
+
+    m_Trials.clear();
+    m_Tasks.clear();
+    for(int i=0;i<runs.size();i++)
+        m_Trials.push_back(Trial(this,runs[i]));
+    for(int i=0;i<m_Trials.size();i++)
+        m_Tasks.push_back(&m_Trials[i]);
+}
+
+double VEGroup::trial(VariablesHolder& v,int experiment,int c)
+{
+    if(experiment<0 || experiment>=experiments.size() || !experiments[experiment])
+        return NAN;
+    return experiments[experiment]->trial(v,c);
+}
+
+void VEGroup::solvers(std::vector<double>& s)
+{
+    s.assign(2*experiments.size(),-1.0);
+    for(int i=0;i<experiments.size();i++)
+        if(experiments[i])
+        {
+            s[2*i]=experiments[i]->steptype();
+            s[2*i+1]=experiments[i]->solvertolerance();
+        }
+}
+
+void VEGroup::solvers(const std::vector<double>& s)
+{
+    for(int i=0;i<experiments.size() && 2*i+1<s.size();i++)
+        if(experiments[i] && s[2*i]>=0.0)
+        {
+            experiments[i]->steptype((int)s[2*i]);
+            experiments[i]->solvertolerance(s[2*i+1]);
+        }
+}
+
+void VEGroup::timeouts(std::vector<int>& t)
+{
+    t.resize(experiments.size());
+    for(int i=0;i<experiments.size();i++)
+        t[i]=(experiments[i]?experiments[i]->timeouts():0);
+}
+
+int VEGroup::hits()
+{
+    int n=0;
+
+    for(int i=0;i<experiments.size();i++)
+        n+=(experiments[i]?experiments[i]->hits():0);
+    return n;
 }
 
@@ -7,122 +7,161 @@
 #include "AdvXMLParser.h"
 #include "CISBootstrap.hpp"
 #include "utils.h"
+#include "threadpool.h"
 #include <string>
+#include <map>
+#include <list>
 #include <functional>
 #include <algorithm>
+#include <math.h>
+
+
+class NativeModel;
 
 
 // COMP_FUNC is a function object class for <= comparisons on doubles
 #define COMP_FUNC std::less_equal<double>
 
-// define ALLELE as vector of <wstring, double> pairs ( i.e. ALLELE is a vector of 'allele's (pair<wstr,doub>) )
-typedef std::vector<std::pair<std::wstring,double> > ALLELE;
+// Accuracy of evaluation: full or loose for screening
+#define FIDELITY_FULL 0
+#define FIDELITY_SCREEN 1
+
+// model documents read by rank 0, indexed by ModelFilePath
+typedef std::map<std::string,std::string> SOURCES;
+
+// define ALLELE as vector of <symbol id, double> pairs ( i.e. ALLELE is a vector of 'allele's (pair<id,doub>) )
+// the id of an allele name is given by Symbols
+typedef std::vector<std::pair<int,double> > ALLELE;
 
 
 /**
  *	VariablesHolder
  *	
- *	+ m_Vars : a storage for ALLELE variable
- *	
+ *	+ m_Schema : the allele ids in order and the slot of every id, shared by the holders of the same alleles
+ *	+ m_Values : the allele values, contiguous in the order of the schema
  *	
+ *	Alleles are looked up by symbol id, lookups by name are meant for I/O
  **/
 class VariablesHolder
 {
+	public:
+		//Schema - the ids of the alleles in order and the slot of every id (-1 for none)
+		//schemas are never released, every set of alleles is given one once
+		struct Schema
+		{
+			std::vector<int> ids;
+			std::vector<int> slots;
+
+			int slot(int id) const { return ((id>=0 && id<slots.size())?slots[id]:-1); }
+			static const Schema *empty();
+			static const Schema *extend(const Schema *s,int id);	// schema of s followed by id
+		};
+
 	private:
-		ALLELE m_Vars;	//the member that stores alleles in a chromosome form ( i.e. vector <allele=pair<wstring allele_name,double allele_value> > )
+		const Schema *m_Schema;
+		std::vector<double> m_Values;
 
 	public:
-		VariablesHolder() {}
-		VariablesHolder(const VariablesHolder& other) { m_Vars.assign(other.m_Vars.begin(),other.m_Vars.end()); }	//copy other VarHolder's variables into this one
+		VariablesHolder():m_Schema(Schema::empty()) {}
+		VariablesHolder(const VariablesHolder& other):m_Schema(other.m_Schema),m_Values(other.m_Values) {}
 		~VariablesHolder() {}
 
 		// = assign other VarHold to this if different 
 		VariablesHolder& operator=(const VariablesHolder& other)
 		{
 			if(&other!=this)
-			   m_Vars.assign(other.m_Vars.begin(),other.m_Vars.end());
+			{
+			   m_Schema=other.m_Schema;
+			   m_Values.assign(other.m_Values.begin(),other.m_Values.end());
+			}
 			return *this;
 		}
 
-		//indexing VarHold obj by name:value in m_Vars
-		double operator()(const std::wstring& name)
+		//value of the allele of id, 0 if it is not held
+		double operator()(int id)
 		{
-			ALLELE::iterator it=find_if(m_Vars.begin(),m_Vars.end(),
-				  bind1st(pair_equal_to<std::wstring,double>(),name));	//find iterator to the pair in m_Vars for which the "first" member equals name (end if no such pair)
-			return (it==m_Vars.end()?double(0.0):it->second);
+			int slot=m_Schema->slot(id);
+			return (slot<0?double(0.0):m_Values[slot]);
 		}
+		double operator()(const std::wstring& name) { return operator()(Symbols::find(name)); }
 
-		//Update an allele (pair<str name, doub value>) in VarHold's m_Var obj and return updated allele value
-		double operator()(const std::wstring& name,double val)
+		//Update an allele and return updated allele value, the allele is appended if it is not held yet
+		double operator()(int id,double val)
 		{
-			//find if matching allele already exists in VarHold
-			ALLELE::iterator it=find_if(m_Vars.begin(),m_Vars.end(),
-			   bind1st(pair_equal_to<std::wstring,double>(),name));
+			int slot=m_Schema->slot(id);
 
-			if(it!=m_Vars.end())
-			   it->second=val;	//update the allele if it already exists
+			if(slot>=0)
+			   m_Values[slot]=val;
 			else
-			   m_Vars.push_back(std::make_pair<std::wstring,double>(std::wstring(name),double(val)));	//add the allele into m_Var if not stored yet
-	    
+			{
+			   m_Schema=Schema::extend(m_Schema,id);
+			   m_Values.push_back(val);
+			}
 			return val;	//return updated allele value
 		}
+		double operator()(const std::wstring& name,double val) { return operator()(Symbols::id(name),val); }
+
+		//Index search allele id, -1 if index out of range
+		int id(int index)
+		{
+			return ((index>=0 && index<m_Values.size())?m_Schema->ids[index]:-1);
+		}
 
 		//Index search allele name
 		std::wstring name(int index)
 		{
-			//return the name of allele at the index location of allele vector m_Vars (nullwstr if index out of range)
-			return ((index>=0 && index<m_Vars.size())?m_Vars[index].first:std::wstring());
+			//return the name of allele at the index location (nullwstr if index out of range)
+			return Symbols::name(id(index));
 		}
 
-		bool exists(const std::wstring& name)
+		bool exists(int id)
 		{
-			//return existence of allele of given name in m_Vars vector
-			ALLELE::iterator it=find_if(m_Vars.begin(),m_Vars.end(),
-			   bind1st(pair_equal_to<std::wstring,double>(),name));
-			return (it!=m_Vars.end());
+			return (m_Schema->slot(id)>=0);
 		}
+		bool exists(const std::wstring& name) { return exists(Symbols::find(name)); }
 
-		//Size of a VariablesHolder object
+		//Size of a VariablesHolder object i.e. number of alleles held
 		size_t size()
 		{
-			//is the size of m_Vars vector i.e. number of alleles in stored in the m_Vars vector
-			return m_Vars.size();
+			return m_Values.size();
 		}
 
+		//true if other holds the same alleles in the same order
+		bool same_schema(const VariablesHolder& other) const
+		{
+			return (m_Schema==other.m_Schema);
+		}
+
+		//the allele values in the order of the schema
+		double *values() { return (m_Values.empty()?NULL:&m_Values[0]); }
+
 		//collate
-		//Pushback all allele values held in m_Vars onto a supplied ref to vect<doub>
+		//Append all allele values to a supplied ref to vect<doub>
 		void collate(std::vector<double>& v)
 		{
-			for(ALLELE::iterator it=m_Vars.begin();it!=m_Vars.end();++it)
-			{
-				v.push_back(it->second);
-			}
+			v.insert(v.end(),m_Values.begin(),m_Values.end());
 		}
 
-		//print all alleles held in m_Vars
+		//print all alleles held
 		void print()
 		{
-			for(ALLELE::iterator it=m_Vars.begin();it!=m_Vars.end();++it)
+			for(int i=0;i<m_Values.size();i++)
 			{
-				printf("%s->%lf\n",convert(it->first).c_str(),it->second);
+				printf("%s->%lf\n",convert(name(i)).c_str(),m_Values[i]);
 			}
 		}
 
-		//Fill-up the allele values of m_Vars with a supplied reference to vect<doub>, v
+		//Fill-up the allele values with n values at v, e.g. a block of a request message
 		//returns true iff fillup is executed properly
-		bool fillup(std::vector<double>& v)
+		bool fillup(const double *v,size_t n)
 		{
 			//check if the sizes are equal
-			if(v.size()!=m_Vars.size())
+			if(n!=m_Values.size())
 				return false;
-
-			//assign the second members of each allele in m_Vars
-			for(int i=0;i<v.size();i++)
-			{
-				m_Vars[i].second=v[i];
-			}
+			std::copy(v,v+n,m_Values.begin());
 			return true;
 		}
+		bool fillup(std::vector<double>& v) { return fillup(v.empty()?NULL:&v[0],v.size()); }
 };
 
 
@@ -138,11 +177,17 @@ class VirtualExperiment
     public:
         VirtualExperiment();
         ~VirtualExperiment();
-        bool LoadModel(const std::string& model_name);
-        static VirtualExperiment *LoadExperiment(const AdvXMLParser::Element& elem);
+        bool LoadModel(const std::string& model_name,const SOURCES *sources=NULL);
+        bool LoadNative(VariablesHolder& alleles);
+        static VirtualExperiment *LoadExperiment(const AdvXMLParser::Element& elem,VariablesHolder& alleles,const SOURCES *sources=NULL);
         void SetVariables(VariablesHolder& v);
         void SetParameters(VariablesHolder& v);
-        double Evaluate();
+        double Evaluate(double bound=INFINITY);
+        double Evaluate(VariablesHolder& v,double bound);	// residual of the genome, cached
+        void Evaluate(std::vector<VariablesHolder *>& v,std::vector<double>& bound,std::vector<double>& res);
+        void lanes(int n);	// number of genomes evaluated together
+        bool identical(const VirtualExperiment& other) const;	// integrates the same system the same way
+        void share(VirtualExperiment& other);	// score other's assessment points from this integration too
 
         int resultcol() const { return m_nResultColumn; }
         void resultcol(int r) { m_nResultColumn=r; }
@@ -153,6 +198,25 @@ class VirtualExperiment
         double accuracy() const { return m_Accuracy; }
         void accuracy(double a) { m_Accuracy=a; }
 
+        int fidelity() const { return m_Fidelity; }
+        void fidelity(int f) { m_Fidelity=f; }
+
+        double trial(VariablesHolder& v,int c);	// residual of the genome with the c-th candidate solver, NaN if it does not apply
+        static int candidates();	// candidate solvers tuning tries, the first one is the default
+        static bool candidate(int c,int& steptype,double& tolerance);	// solver of the c-th candidate, false if it is not tried
+        static int choose(const std::vector<double>& residuals,const std::vector<double>& seconds,int genomes);
+        static bool autosolver(const AdvXMLParser::Element& elem);	// whether the definition has the solver picked by tuning
+        bool tuned() const { return m_Tune; }
+        int steptype() const { return m_StepType; }
+        void steptype(int s) { m_StepType=s; }
+        static const char *stepname(int steptype);
+        double solvertolerance() const { return m_Tolerance; }
+        void solvertolerance(double t) { m_Tolerance=t; }
+
+        int timeouts() const { return m_Timeouts; }	// evaluations given up for taking too long
+        int hits() const { return m_Hits; }	// evaluations answered from the residual cache
+        const std::string& name() const { return m_strModelName; }
+
         void Run();
 
 	private:
@@ -173,21 +237,99 @@ class VirtualExperiment
 
         friend class Runner;
 
-        double getSSRD(std::vector<std::pair<int,double> >& d);
+		//Bound monitors the residual accumulated while integrating
+		//and aborts the integration as soon as it exceeds the bound
+        struct Bound;
+        friend struct Bound;
+
+        double score(const double *rec,std::vector<int>& matched);
+        bool assessed(const std::vector<int>& matched) const;
+        bool LoadData(const AdvXMLParser::Element& elem);
+        double endtime();
+        void reporttimes();
+        double tolerance();
+        double reportstep();
+        double EvaluateNative(double bound);
+        void EvaluateLanes(std::vector<VariablesHolder *>& v,std::vector<double>& bound,std::vector<double>& res);
+        void dependencies(VariablesHolder& alleles);
+        void Assign();
+        double input(VariablesHolder& v,int id);
+        void key(VariablesHolder& v);
+        bool cached(VariablesHolder& v,double bound,double& res);
+        void remember(VariablesHolder& v,double bound,double res);
+        double timelimit(int lanes=1);
+        void timed(double seconds,int lanes=1);
         std::string m_strModelName;
         ObjRef<iface::cellml_api::Model> m_Model;
+        NativeModel *m_pNative;	// compiled model code, NULL to use the integration service
 		int m_nResultColumn;
         
 		// Type definitions
 		typedef std::map<std::wstring,double>	PARAMS;
-        typedef std::pair<double,double>		POINT;
-        typedef std::vector<POINT>				TIMEPOINTS;
+
+		//Targets of a result column at the assessment times
+		//rows of a time followed by target values, sorted by time, held by m_Points or mapped from a data file
+        struct OBSERVABLE
+        {
+            const double *rows;
+            int stride;		// values per row
+            int target;		// offset of the target of the observable in a row
+            int count;		// rows
+            int column;		// result column of the observable
+            double weight;	// weight of the deviation of the observable
+            int member;		// experiment the observable is assessed for, 0 for this one, then those shared in turn
+
+            double time(int row) const { return rows[row*stride]; }
+            double value(int row) const { return rows[row*stride+target]; }
+        };
+        typedef std::vector<OBSERVABLE>			OBSERVABLES;
 
         PARAMS m_Parameters;
-        TIMEPOINTS m_Timepoints;
+        OBSERVABLES m_Observables;	// including the shared ones
+        int m_Members;		// experiments m_Observables are assessed for, this one and those shared
+        std::list<std::vector<double> > m_Points;	// rows of the AssessmentPoints sets
+        std::vector<double> m_Times;	// times native model reports at
         double m_ReportStep;
         unsigned long m_MaxTime;
         double m_Accuracy;
+        int m_Fidelity;			// FIDELITY_xxx of the following evaluations
+        double m_ScreenTolerance;	// solver tolerance of screening evaluations
+        double m_ScreenReportStep;	// report step of screening evaluations
+        int m_StepType;			// ODEIntegrationStepType of the integration service
+        double m_Tolerance;		// solver tolerance of full accuracy evaluations
+        bool m_Tune;			// solver is picked by tuning
+
+		//Timing - running distribution of the durations of complete integrations
+        struct Timing
+        {
+            Timing():next(0),limit(0.0) {}
+
+            std::vector<double> samples;	// most recent durations per genome
+            int next;		// sample to be replaced next once all are in
+            double limit;	// adaptive time limit per genome, 0 until enough samples are in
+        };
+        Timing m_Timing[2];	// per fidelity
+        double m_TimeoutFactor;	// limit as a multiple of the percentile of the durations, 0 for none
+        int m_Timeouts;
+
+		//Residual cached for the values of the alleles the model depends on
+        struct Residual
+        {
+            double value;
+            bool exact;		// otherwise value is a lower bound of an aborted evaluation
+        };
+        typedef std::map<std::vector<double>,Residual> RESIDUALS;
+
+        std::vector<int> m_Relevant;	// ids of the alleles naming variables of the model
+        RESIDUALS m_Residuals;
+        int m_Hits;
+
+		//Model variables the alleles are assigned to, looked up once the experiment is loaded
+        typedef std::vector<std::pair<int,ObjRef<iface::cellml_api::CellMLVariable> > > BINDINGS;
+        BINDINGS m_Bindings;
+        std::map<int,double> m_Defaults;	// value of a bound variable if the genome holds NaN for its allele, by allele id
+        std::vector<int> m_InputIds;	// allele ids of the inputs of the compiled model
+        std::vector<double> m_Key;	// fidelity and the relevant allele values of a genome
 };
 
 
@@ -202,17 +344,68 @@ class VEGroup
 		// get the singleton VE group object
         static VEGroup& instance();
 
-		// TODO
-        double Evaluate(VariablesHolder& v);
+		// evaluate average residual, giving up once it is known to exceed bound
+        double Evaluate(VariablesHolder& v,double bound,bool& bounded);
+
+		// evaluate residual of a single experiment, giving up once it is known to exceed bound
+        double Evaluate(VariablesHolder& v,int experiment,double bound,bool& bounded);
+
+		// evaluate average residuals of the first n genomes together
+        void Evaluate(std::vector<VariablesHolder>& v,int n,std::vector<double>& bound,std::vector<double>& res,std::vector<bool>& bounded);
+
+		// number of experiments in the group
+        int count() const { return experiments.size(); }
+
+		// number of genomes evaluated together
+        void lanes(int n);
+
+		// accuracy of the following evaluations
+        void fidelity(int f);
 
 		// TODO
         void add(VirtualExperiment *p);
 
+		// integrate experiments of identical simulations once, must be called before threads
+        void share();
+
+		// evaluate the experiments concurrently on n threads
+        void threads(int n);
+
+		// number of timeouts of every experiment
+        void timeouts(std::vector<int>& t);
+
+		// evaluations of all the experiments answered from the residual caches
+        int hits();
+
+		// residual of the experiment with the c-th candidate solver, NaN if it is not loaded or the candidate does not apply
+        double trial(VariablesHolder& v,int experiment,int c);
+
+		// step type and tolerance of every experiment, a pair per experiment, -1 for experiments not loaded
+        void solvers(std::vector<double>& s);
+        void solvers(const std::vector<double>& s);
+
+		// experiment i
+        VirtualExperiment *experiment(int i) { return experiments[i]; }
+
     protected:
         typedef std::vector<VirtualExperiment *> VE;
         
 		// a vector of pointers to virtual experiments
 		VE experiments;
+		// experiments to integrate, each of them scores those sharing its simulation as well
+		VE runs;
+
+    private:
+		// Trial evaluates a single experiment on the thread pool
+        struct Trial;
+        friend struct Trial;
+
+        double EvaluateParallel(VariablesHolder& v,double bound,bool& bounded);
+
+        ThreadPool m_Pool;
+        std::vector<Trial> m_Trials;	// one per experiment
+        std::vector<Task *> m_Tasks;
+        double m_Total;		// the total residual must stay within
 };
 
 #endif